@@ -0,0 +1,281 @@
+#ifndef MAKSIMA_BULK_LOAD_H
+#define MAKSIMA_BULK_LOAD_H
+
+// Wczytywanie dużych plików tekstowych z wierszami "arg,value" (albo
+// "arg<TAB>value") do FunctionMaxima. Plik jest mapowany do pamięci,
+// dzielony na kawałki na granicach wierszy i parsowany równolegle na puli
+// (concurrency() i parallel_for, np. WorkStealingPool). Wiersze w kolejności
+// z pliku trafiają do assign_sorted (pusta funkcja) albo apply_parallel,
+// więc wynik jest taki sam jak przy kolejnych set_value - przy powtórzonym
+// argumencie wygrywa ostatni wiersz.
+// Wiersze, których nie da się sparsować (np. nagłówek), są pomijane, tak
+// jak w maksima_ingest.
+//
+// Liczby całkowite parsujemy bez rozgałęzień po 8 cyfr naraz (SWAR: jedno
+// słowo 64-bitowe, kilka mnożeń), a resztę i liczby zmiennoprzecinkowe -
+// std::from_chars. Końce wierszy znajduje memchr, który biblioteka
+// standardowa i tak wektoryzuje.
+
+#include "function_maxima.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <charconv>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace maxima_load {
+
+// Plik zmapowany tylko do odczytu.
+class mapped_file {
+public:
+    explicit mapped_file(std::string const& path) {
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            fail("cannot open", path);
+        struct stat st;
+        if (::fstat(fd, &st) != 0) {
+            ::close(fd);
+            fail("cannot stat", path);
+        }
+        size = static_cast<std::size_t>(st.st_size);
+        if (size > 0) {
+            void* p = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (p == MAP_FAILED) {
+                ::close(fd);
+                fail("cannot map", path);
+            }
+            data = static_cast<char const*>(p);
+            ::madvise(p, size, MADV_SEQUENTIAL);
+        }
+        ::close(fd);
+    }
+
+    mapped_file(mapped_file const&) = delete;
+    mapped_file& operator=(mapped_file const&) = delete;
+
+    ~mapped_file() {
+        if (data)
+            ::munmap(const_cast<char*>(data), size);
+    }
+
+    std::string_view text() const noexcept {
+        return {data, size};
+    }
+
+private:
+    char const* data = nullptr;
+    std::size_t size = 0;
+
+    [[noreturn]] static void fail(char const* what, std::string const& path) {
+        throw std::runtime_error(std::string(what) + " " + path + ": " + std::strerror(errno));
+    }
+};
+
+namespace detail {
+
+// Czy wszystkie 8 bajtów słowa to cyfry ASCII.
+inline bool eight_digits(std::uint64_t w) noexcept {
+    return (w & 0xf0f0f0f0f0f0f0f0) == 0x3030303030303030
+        && ((w + 0x0606060606060606) & 0xf0f0f0f0f0f0f0f0) == 0x3030303030303030;
+}
+
+// Wartość 8 cyfr ASCII zapisanych w słowie (pierwsza cyfra w najmłodszym
+// bajcie): łączymy sąsiednie cyfry w pary, pary w czwórki, czwórki w całość.
+inline std::uint64_t eight_digits_value(std::uint64_t w) noexcept {
+    w -= 0x3030303030303030;
+    w = (w * 10 + (w >> 8)) & 0x00ff00ff00ff00ff;
+    w = (w * 100 + (w >> 16)) & 0x0000ffff0000ffff;
+    return (w * 10000 + (w >> 32)) & 0xffffffff;
+}
+
+// Jak std::from_chars dla typów całkowitych: zwraca wskaźnik za liczbą albo
+// nullptr, gdy liczby nie ma lub nie mieści się w T.
+template <typename T>
+char const* parse_integer(char const* p, char const* end, T& out) noexcept {
+    char const* start = p;
+    bool negative = false;
+    if constexpr (std::is_signed_v<T>) {
+        if (p < end && *p == '-') {
+            negative = true;
+            ++p;
+        }
+    }
+    char const* digits = p;
+    std::uint64_t x = 0;
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    // Dwa słowa po 8 cyfr nie przepełnią 64 bitów.
+    for (int k = 0; k < 2 && end - p >= 8; ++k) {
+        std::uint64_t w;
+        std::memcpy(&w, p, 8);
+        if (!eight_digits(w))
+            break;
+        x = x * 100000000 + eight_digits_value(w);
+        p += 8;
+    }
+#endif
+    while (p < end && p - digits < 18 && static_cast<unsigned char>(*p - '0') < 10)
+        x = x * 10 + static_cast<unsigned>(*p++ - '0');
+    if (p == digits)
+        return nullptr;
+    if (p < end && static_cast<unsigned char>(*p - '0') < 10) {
+        // Co najmniej 19 cyfr - zostawiamy sprawdzanie zakresu bibliotece.
+        auto [after, ec] = std::from_chars(start, end, out);
+        return ec == std::errc() ? after : nullptr;
+    }
+    using U = std::make_unsigned_t<T>;
+    U limit = static_cast<U>(std::numeric_limits<T>::max()) + (negative ? 1 : 0);
+    if (x > limit)
+        return nullptr;
+    out = negative ? static_cast<T>(U(0) - static_cast<U>(x)) : static_cast<T>(x);
+    return p;
+}
+
+template <typename T>
+char const* parse_number(char const* p, char const* end, T& out) noexcept {
+    if constexpr (std::is_integral_v<T>) {
+        return parse_integer(p, end, out);
+    } else {
+        auto [after, ec] = std::from_chars(p, end, out);
+        return ec == std::errc() ? after : nullptr;
+    }
+}
+
+// Parsuje wiersze zaczynające się w [first, last) tekstu kończącego się
+// w end i dopisuje je do rows. Zwraca liczbę pominiętych wierszy.
+template <typename A, typename V>
+std::size_t parse_rows(char const* first, char const* last, char const* end,
+                       std::vector<std::pair<A, V>>& rows) {
+    std::size_t skipped = 0;
+    char const* p = first;
+    while (p < last) {
+        char const* line_end = static_cast<char const*>(
+                std::memchr(p, '\n', static_cast<std::size_t>(end - p)));
+        if (line_end == nullptr)
+            line_end = end;
+        A a{};
+        V v{};
+        char const* after_arg = parse_number(p, line_end, a);
+        if (after_arg != nullptr && after_arg < line_end
+            && (*after_arg == ',' || *after_arg == '\t')
+            && parse_number(after_arg + 1, line_end, v) != nullptr)
+            rows.emplace_back(a, v);
+        else if (line_end > p)
+            ++skipped;
+        p = line_end + 1;
+    }
+    return skipped;
+}
+
+} // namespace detail
+
+struct load_stats {
+    std::size_t bytes = 0;
+    std::size_t rows = 0;     // sparsowane wiersze
+    std::size_t skipped = 0;  // niepuste wiersze, których nie dało się sparsować
+    double parse_seconds = 0;
+    double build_seconds = 0;
+
+    double rows_per_second() const noexcept {
+        double total = parse_seconds + build_seconds;
+        return total > 0 ? static_cast<double>(rows) / total : 0;
+    }
+};
+
+// Parsuje tekst w kawałkach na puli; wiersze w kolejności z tekstu.
+template <typename A, typename V, typename Pool>
+std::vector<std::pair<A, V>> parse(std::string_view text, Pool& pool, load_stats& stats) {
+    char const* begin = text.data();
+    char const* end = begin + text.size();
+    // Kilka kawałków na wątek, żeby wyrównać ich nierówne koszty, ale nie
+    // mniejszych niż 1 MiB.
+    std::size_t pieces = std::max<std::size_t>(
+            1, std::min<std::size_t>(pool.concurrency() * 4, text.size() >> 20));
+    std::vector<char const*> bounds(pieces + 1, end);
+    bounds[0] = begin;
+    for (std::size_t i = 1; i < pieces; ++i) {
+        char const* p = begin + text.size() / pieces * i;
+        if (p < bounds[i - 1])
+            p = bounds[i - 1];
+        char const* nl = static_cast<char const*>(std::memchr(p, '\n', static_cast<std::size_t>(end - p)));
+        bounds[i] = nl ? nl + 1 : end;
+    }
+
+    std::vector<std::vector<std::pair<A, V>>> parts(pieces);
+    std::vector<std::size_t> skipped(pieces);
+    pool.parallel_for(pieces, [&](std::size_t i) {
+        // Szacunek: co najmniej 4 bajty na wiersz.
+        parts[i].reserve(static_cast<std::size_t>(bounds[i + 1] - bounds[i]) / 8);
+        skipped[i] = detail::parse_rows(bounds[i], bounds[i + 1], end, parts[i]);
+    });
+
+    std::vector<std::size_t> offset(pieces + 1, 0);
+    for (std::size_t i = 0; i < pieces; ++i) {
+        offset[i + 1] = offset[i] + parts[i].size();
+        stats.skipped += skipped[i];
+    }
+    std::vector<std::pair<A, V>> rows(offset[pieces]);
+    pool.parallel_for(pieces, [&](std::size_t i) {
+        std::move(parts[i].begin(), parts[i].end(), rows.begin() + static_cast<std::ptrdiff_t>(offset[i]));
+        parts[i] = {};
+    });
+    stats.rows += rows.size();
+    return rows;
+}
+
+// Wczytuje plik path do f (jak kolejne set_value dla jego wierszy). Silna
+// gwarancja dla f; błędy odczytu pliku zgłasza jako std::runtime_error.
+template <typename A, typename V, typename Pool>
+load_stats load_file(std::string const& path, FunctionMaxima<A, V>& f, Pool& pool) {
+    using clock = std::chrono::steady_clock;
+    load_stats stats;
+    auto start = clock::now();
+    std::vector<std::pair<A, V>> rows;
+    {
+        mapped_file file(path);
+        stats.bytes = file.text().size();
+        rows = parse<A, V>(file.text(), pool, stats);
+    }
+    auto parsed = clock::now();
+    stats.parse_seconds = std::chrono::duration<double>(parsed - start).count();
+    if (f.size() == 0) {
+        // Pusta funkcja: sortujemy wiersze stabilnie (powtórzenia zostają
+        // w kolejności z pliku), zostawiamy ostatnie i budujemy funkcję od
+        // razu z posortowanych punktów, bez wyszukiwań w drzewach.
+        using row = std::pair<A, V>;
+        maxima_detail::parallel_stable_sort(rows, [](row const& x, row const& y) {
+            return x.first < y.first;
+        }, pool, std::max<std::size_t>(1, pool.concurrency() * 4));
+        std::size_t k = 0;
+        for (std::size_t i = 0; i < rows.size(); ++i) {
+            if (i + 1 < rows.size() && !(rows[i].first < rows[i + 1].first))
+                continue;
+            if (k != i)
+                rows[k] = std::move(rows[i]);
+            ++k;
+        }
+        f.assign_sorted(rows.begin(), rows.begin() + static_cast<std::ptrdiff_t>(k));
+    } else {
+        f.apply_parallel(std::move(rows), pool);
+    }
+    stats.build_seconds = std::chrono::duration<double>(clock::now() - parsed).count();
+    return stats;
+}
+
+} // namespace maxima_load
+
+#endif //MAKSIMA_BULK_LOAD_H
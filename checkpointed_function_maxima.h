@@ -0,0 +1,394 @@
+#ifndef MAKSIMA_CHECKPOINTED_FUNCTION_MAXIMA_H
+#define MAKSIMA_CHECKPOINTED_FUNCTION_MAXIMA_H
+
+// Przyrostowe punkty kontrolne FunctionMaxima w katalogu. Pliki:
+//   delta-<nr>.mkd - argumenty zmienione od poprzedniego punktu kontrolnego
+//                    z ich wartościami (lub znacznikiem usunięcia),
+//   base-<nr>.mkb  - wszystkie punkty funkcji po uwzględnieniu delt o numerach
+//                    nie większych niż nr.
+// Rekordy w plikach są posortowane po argumentach, a każdy plik powstaje
+// jako tymczasowy i dopiero po fsync dostaje docelową nazwę, więc w katalogu
+// są tylko kompletne pliki. Odtworzenie to baza o największym numerze
+// i kolejne delty za nią: każdą deltę scalamy z wynikiem liniowo, a funkcję
+// budujemy na końcu z posortowanych punktów (assign_sorted). Kompaktowanie
+// scala bazę z deltami w nową bazę w wątku w tle i usuwa scalone pliki - nie
+// dotyka przy tym samej funkcji, więc nie wstrzymuje zapisów.
+//
+// Format jest binarny, zależny od platformy: A i V muszą być trywialnie
+// kopiowalne. Błędy wejścia-wyjścia i uszkodzone pliki zgłaszamy jako
+// std::runtime_error.
+
+#include "function_maxima.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <exception>
+#include <filesystem>
+#include <optional>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace maxima_checkpoint {
+
+namespace fs = std::filesystem;
+
+struct header {
+    char magic[4];
+    std::uint32_t arg_size;
+    std::uint32_t value_size;
+    std::uint32_t reserved;
+    std::uint64_t count;
+};
+
+// Baza nie zawiera usunięć, więc jej rekordy nie mają znacznika obecności.
+enum class kind { base, delta };
+
+inline char const* magic(kind k) noexcept {
+    return k == kind::base ? "MKSB" : "MKSD";
+}
+
+// Punkt albo (bez wartości) usunięcie argumentu.
+template <typename A, typename V>
+using record = std::pair<A, std::optional<V>>;
+
+// Numery plików w katalogu: największy numer bazy i numery delt za nią.
+struct listing {
+    std::optional<std::uint64_t> base;
+    std::vector<std::uint64_t> deltas;  // rosnąco
+    std::uint64_t last = 0;             // największy numer w ogóle
+};
+
+inline fs::path base_path(fs::path const& dir, std::uint64_t n) {
+    return dir / ("base-" + std::to_string(n) + ".mkb");
+}
+
+inline fs::path delta_path(fs::path const& dir, std::uint64_t n) {
+    return dir / ("delta-" + std::to_string(n) + ".mkd");
+}
+
+inline listing list(fs::path const& dir) {
+    listing l;
+    std::vector<std::uint64_t> deltas;
+    for (fs::directory_entry const& e : fs::directory_iterator(dir)) {
+        std::string name = e.path().filename().string();
+        std::string ext = e.path().extension().string();
+        bool base = name.rfind("base-", 0) == 0 && ext == ".mkb";
+        bool delta = name.rfind("delta-", 0) == 0 && ext == ".mkd";
+        if (!base && !delta)
+            continue;
+        std::size_t from = base ? 5 : 6;
+        std::string digits = name.substr(from, name.size() - from - 4);
+        if (digits.empty() || digits.find_first_not_of("0123456789") != std::string::npos)
+            continue;
+        std::uint64_t n = std::stoull(digits);
+        l.last = std::max(l.last, n);
+        if (base && (!l.base || *l.base < n))
+            l.base = n;
+        if (delta)
+            deltas.push_back(n);
+    }
+    std::sort(deltas.begin(), deltas.end());
+    for (std::uint64_t n : deltas) {
+        if (!l.base || *l.base < n)
+            l.deltas.push_back(n);
+    }
+    return l;
+}
+
+[[noreturn]] inline void fail(std::string const& what, fs::path const& path) {
+    throw std::runtime_error(what + " " + path.string() + ": " + std::strerror(errno));
+}
+
+class file {
+public:
+    file(fs::path const& path, char const* mode) : f(std::fopen(path.c_str(), mode)), path(path) {
+        if (f == nullptr)
+            fail("cannot open", path);
+    }
+    file(file const&) = delete;
+    file& operator=(file const&) = delete;
+    ~file() {
+        if (f)
+            std::fclose(f);
+    }
+
+    void write(void const* data, std::size_t n) {
+        if (std::fwrite(data, 1, n, f) != n)
+            fail("cannot write", path);
+    }
+
+    void read(void* data, std::size_t n) {
+        if (std::fread(data, 1, n, f) != n)
+            throw std::runtime_error("truncated checkpoint " + path.string());
+    }
+
+    // Zapisuje bufory na dysk i zamyka plik.
+    void sync() {
+        if (std::fflush(f) != 0 || ::fsync(::fileno(f)) != 0)
+            fail("cannot sync", path);
+        std::FILE* g = f;
+        f = nullptr;
+        if (std::fclose(g) != 0)
+            fail("cannot close", path);
+    }
+
+private:
+    std::FILE* f;
+    fs::path path;
+};
+
+inline void sync_dir(fs::path const& dir) {
+    int fd = ::open(dir.c_str(), O_RDONLY | O_DIRECTORY);
+    if (fd < 0)
+        fail("cannot open", dir);
+    int r = ::fsync(fd);
+    ::close(fd);
+    if (r != 0)
+        fail("cannot sync", dir);
+}
+
+// Zapisuje posortowane rekordy do pliku path (przez plik tymczasowy).
+template <typename A, typename V>
+void write(fs::path const& path, kind k, std::vector<record<A, V>> const& records) {
+    fs::path tmp = path;
+    tmp += ".tmp";
+    {
+        file out(tmp, "wb");
+        header h{};
+        std::memcpy(h.magic, magic(k), 4);
+        h.arg_size = sizeof(A);
+        h.value_size = sizeof(V);
+        h.count = records.size();
+        out.write(&h, sizeof h);
+        for (auto const& [a, v] : records) {
+            out.write(&a, sizeof(A));
+            std::uint8_t present = v.has_value();
+            if (k == kind::delta)
+                out.write(&present, 1);
+            if (v)
+                out.write(&*v, sizeof(V));
+        }
+        out.sync();
+    }
+    fs::rename(tmp, path);
+    sync_dir(path.parent_path());
+}
+
+template <typename A, typename V>
+std::vector<record<A, V>> read(fs::path const& path, kind k) {
+    file in(path, "rb");
+    header h;
+    in.read(&h, sizeof h);
+    if (std::memcmp(h.magic, magic(k), 4) != 0 || h.arg_size != sizeof(A) || h.value_size != sizeof(V))
+        throw std::runtime_error("not a checkpoint of this function type: " + path.string());
+    // Liczba rekordów z uszkodzonego nagłówka nie może wymusić ogromnej
+    // rezerwacji - najkrótszy rekord (usunięcie w delcie, punkt w bazie)
+    // ogranicza ją przez rozmiar reszty pliku.
+    std::uint64_t shortest = sizeof(A) + (k == kind::delta ? 1 : sizeof(V));
+    std::uint64_t rest = fs::file_size(path) - sizeof h;
+    if (h.count > rest / shortest)
+        throw std::runtime_error("corrupt checkpoint " + path.string() + ": "
+                                 + std::to_string(h.count) + " records in "
+                                 + std::to_string(rest) + " bytes");
+    std::vector<record<A, V>> records;
+    records.reserve(h.count);
+    for (std::uint64_t i = 0; i < h.count; ++i) {
+        A a;
+        in.read(&a, sizeof(A));
+        std::uint8_t present = 1;
+        if (k == kind::delta)
+            in.read(&present, 1);
+        std::optional<V> v;
+        if (present) {
+            V value;
+            in.read(&value, sizeof(V));
+            v = value;
+        }
+        records.emplace_back(a, v);
+    }
+    return records;
+}
+
+// Scala posortowane rekordy w czasie liniowym: przy równych argumentach
+// wygrywa newer, a usunięcia znikają z wyniku.
+template <typename A, typename V>
+std::vector<record<A, V>> merge(std::vector<record<A, V>> older, std::vector<record<A, V>> const& newer) {
+    std::vector<record<A, V>> out;
+    out.reserve(older.size() + newer.size());
+    auto emit = [&](record<A, V> r) {
+        if (r.second)
+            out.push_back(std::move(r));
+    };
+    auto o = older.begin();
+    auto n = newer.begin();
+    while (o != older.end() || n != newer.end()) {
+        if (n == newer.end() || (o != older.end() && o->first < n->first)) {
+            emit(std::move(*o++));
+        } else {
+            if (o != older.end() && !(n->first < o->first))
+                ++o;
+            emit(*n++);
+        }
+    }
+    return out;
+}
+
+// Rekordy bazy base_nr scalone z deltami (bez usunięć).
+template <typename A, typename V>
+std::vector<record<A, V>> replay(fs::path const& dir, std::optional<std::uint64_t> base_nr,
+                                 std::vector<std::uint64_t> const& deltas) {
+    std::vector<record<A, V>> points;
+    if (base_nr)
+        points = read<A, V>(base_path(dir, *base_nr), kind::base);
+    for (std::uint64_t n : deltas)
+        points = merge(std::move(points), read<A, V>(delta_path(dir, n), kind::delta));
+    return points;
+}
+
+} // namespace maxima_checkpoint
+
+template <typename A, typename V>
+class CheckpointedFunctionMaxima {
+    static_assert(std::is_trivially_copyable_v<A> && std::is_trivially_copyable_v<V>,
+                  "punkty kontrolne zapisują A i V bajt po bajcie");
+
+public:
+    using function_type = FunctionMaxima<A, V>;
+
+    // Otwiera katalog punktów kontrolnych (tworząc go w razie potrzeby)
+    // i odtwarza z niego funkcję.
+    explicit CheckpointedFunctionMaxima(std::string dir) : dir(std::move(dir)) {
+        maxima_checkpoint::fs::create_directories(this->dir);
+        f = restore(this->dir);
+        next = maxima_checkpoint::list(this->dir).last + 1;
+    }
+
+    CheckpointedFunctionMaxima(CheckpointedFunctionMaxima const&) = delete;
+    CheckpointedFunctionMaxima& operator=(CheckpointedFunctionMaxima const&) = delete;
+
+    ~CheckpointedFunctionMaxima() {
+        if (compactor.joinable())
+            compactor.join();
+    }
+
+    // Funkcja z bazy i delt w katalogu dir.
+    static function_type restore(std::string const& dir) {
+        std::vector<maxima_checkpoint::record<A, V>> records;
+        for (;;) {
+            maxima_checkpoint::listing l = maxima_checkpoint::list(dir);
+            try {
+                records = maxima_checkpoint::replay<A, V>(dir, l.base, l.deltas);
+                break;
+            } catch (std::runtime_error const&) {
+                // Kompaktowanie mogło w międzyczasie zastąpić odczytywane
+                // pliki nową bazą - wtedy zaczynamy od niej.
+                if (maxima_checkpoint::list(dir).base == l.base)
+                    throw;
+            }
+        }
+        std::vector<std::pair<A, V>> points;
+        points.reserve(records.size());
+        for (auto& [a, v] : records)
+            points.emplace_back(a, *v);
+        records = {};
+        function_type f;
+        f.assign_sorted(points.begin(), points.end());
+        return f;
+    }
+
+    function_type const& function() const noexcept {
+        return f;
+    }
+
+    // Jak w FunctionMaxima, dodatkowo zapamiętują zmieniony argument.
+    // Silna gwarancja (nadmiarowo zapamiętany argument niczego nie psuje).
+    void set_value(A const& a, V const& v) {
+        changed.insert(a);
+        f.set_value(a, v);
+    }
+
+    void erase(A const& a) {
+        changed.insert(a);
+        f.erase(a);
+    }
+
+    // Liczba argumentów zmienionych od ostatniego punktu kontrolnego.
+    std::size_t pending() const noexcept {
+        return changed.size();
+    }
+
+    // Zapisuje deltę z argumentami zmienionymi od poprzedniego punktu
+    // kontrolnego w czasie O(k log n) dla k zmian. Silna gwarancja: jeśli
+    // zapis się nie uda, zmiany trafią do następnej delty.
+    void checkpoint() {
+        if (changed.empty())
+            return;
+        std::vector<maxima_checkpoint::record<A, V>> records;
+        records.reserve(changed.size());
+        for (A const& a : changed) {
+            auto it = f.find(a);
+            if (it == f.end())
+                records.emplace_back(a, std::nullopt);
+            else
+                records.emplace_back(a, it->value());
+        }
+        maxima_checkpoint::write<A, V>(maxima_checkpoint::delta_path(dir, next),
+                                       maxima_checkpoint::kind::delta, records);
+        ++next;
+        changed.clear();
+    }
+
+    // Uruchamia w tle scalenie bazy i wszystkich zapisanych delt w nową
+    // bazę; wcześniej czeka na poprzednie kompaktowanie (i zgłasza jego
+    // błąd). Nie blokuje set_value, erase ani checkpoint.
+    void compact() {
+        wait_compaction();
+        maxima_checkpoint::listing l = maxima_checkpoint::list(dir);
+        if (l.deltas.empty())
+            return;
+        std::string d = dir;
+        compactor = std::thread([this, d, l] {
+            try {
+                namespace mc = maxima_checkpoint;
+                auto points = mc::replay<A, V>(d, l.base, l.deltas);
+                std::uint64_t nr = l.deltas.back();
+                mc::write<A, V>(mc::base_path(d, nr), mc::kind::base, points);
+                if (l.base)
+                    mc::fs::remove(mc::base_path(d, *l.base));
+                for (std::uint64_t n : l.deltas)
+                    mc::fs::remove(mc::delta_path(d, n));
+            } catch (...) {
+                compaction_error = std::current_exception();
+            }
+        });
+    }
+
+    // Czeka na zakończenie kompaktowania i zgłasza jego ewentualny błąd.
+    void wait_compaction() {
+        if (compactor.joinable())
+            compactor.join();
+        if (compaction_error)
+            std::rethrow_exception(std::exchange(compaction_error, nullptr));
+    }
+
+private:
+    std::string dir;
+    function_type f;
+    std::set<A> changed;
+    std::uint64_t next = 1;  // numer następnej delty
+    std::thread compactor;
+    std::exception_ptr compaction_error;
+};
+
+#endif //MAKSIMA_CHECKPOINTED_FUNCTION_MAXIMA_H
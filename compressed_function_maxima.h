@@ -0,0 +1,446 @@
+#ifndef MAKSIMA_COMPRESSED_FUNCTION_MAXIMA_H
+#define MAKSIMA_COMPRESSED_FUNCTION_MAXIMA_H
+
+#include "function_maxima.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <type_traits>
+#include <vector>
+
+// Skompresowana, przeznaczona głównie do odczytu funkcja dla archiwów
+// z całkowitymi argumentami (np. znacznikami czasu). Punkty są dopisywane
+// na koniec (append) w rosnącej kolejności argumentów i grupowane w bloki
+// po block_size punktów. W bloku argumenty są zapisane jako różnice kolejnych
+// argumentów w kodowaniu varint (LEB128), a wartości całkowite jako
+// przesunięcia względem minimum bloku, upakowane na tylu bitach, ile wymaga
+// rozpiętość wartości w bloku (wartości zmiennoprzecinkowe - bez kompresji).
+// Nagłówek bloku przechowuje pierwszy argument, minimum i maksimum wartości.
+// Dla regularnych znaczników czasu i wolnozmiennych wartości daje to kilka
+// bajtów na punkt zamiast dwóch shared_ptr i węzła drzewa.
+//
+// find szuka binarnie bloku po nagłówkach, a potem dekoduje blok (O(log n +
+// block_size)). Zapytania o maksima przeglądają bloki w kolejności
+// argumentów i pomijają całe bloki, których maksimum jest za małe; nie ma
+// osobnego zbioru maksimów, więc nie ma też mx_begin uporządkowanego po
+// wartościach. Ostatni, niepełny blok jest trzymany bez kompresji.
+template <typename A, typename V>
+class CompressedFunctionMaxima {
+    static_assert(std::is_integral_v<A>, "CompressedFunctionMaxima wymaga całkowitych argumentów");
+    static_assert(std::is_arithmetic_v<V>, "CompressedFunctionMaxima wymaga liczbowych wartości");
+
+public:
+    using size_type = std::size_t;
+
+    static constexpr size_type block_size = 128;
+
+    // Punkt odkodowany z bloku; żyje w iteratorze.
+    class point_type {
+    private:
+        A a{};
+        V v{};
+        friend class CompressedFunctionMaxima;
+    public:
+        A const& arg() const noexcept {
+            return a;
+        }
+        V const& value() const noexcept {
+            return v;
+        }
+    };
+
+    class const_iterator {
+    private:
+        CompressedFunctionMaxima const* c = nullptr;
+        size_type block = 0;
+        size_type index = 0;
+        size_type byte = 0;  // następna różnica argumentów w bloku
+        point_type p;
+
+        const_iterator(CompressedFunctionMaxima const* c, size_type block) noexcept
+            : c(c), block(block) {
+            load_first();
+        }
+
+        void load_first() noexcept {
+            index = 0;
+            if (block < c->blocks.size()) {
+                byte = c->blocks[block].arg_offset;
+                p.a = c->blocks[block].first_arg;
+                p.v = c->value_of(block, 0);
+            } else if (block == c->blocks.size() && !c->tail_args.empty()) {
+                p.a = c->tail_args[0];
+                p.v = c->tail_values[0];
+            }
+        }
+
+        friend class CompressedFunctionMaxima;
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = point_type;
+        using difference_type = std::ptrdiff_t;
+        using pointer = point_type const*;
+        using reference = point_type const&;
+
+        const_iterator() noexcept = default;
+
+        reference operator*() const noexcept {
+            return p;
+        }
+        pointer operator->() const noexcept {
+            return &p;
+        }
+        const_iterator& operator++() noexcept {
+            if (++index == c->block_count(block)) {
+                ++block;
+                load_first();
+            } else if (block < c->blocks.size()) {
+                p.a = static_cast<A>(static_cast<U>(p.a) + c->read_delta(byte));
+                p.v = c->value_of(block, index);
+            } else {
+                p.a = c->tail_args[index];
+                p.v = c->tail_values[index];
+            }
+            return *this;
+        }
+        const_iterator operator++(int) noexcept {
+            const_iterator old = *this;
+            ++*this;
+            return old;
+        }
+        friend bool operator==(const_iterator const& x, const_iterator const& y) noexcept {
+            return x.block == y.block && x.index == y.index;
+        }
+        friend bool operator!=(const_iterator const& x, const_iterator const& y) noexcept {
+            return !(x == y);
+        }
+    };
+    using iterator = const_iterator;
+
+    CompressedFunctionMaxima() = default;
+
+    // Kompresuje punkty funkcji f.
+    explicit CompressedFunctionMaxima(FunctionMaxima<A, V> const& f) {
+        for (auto const& p : f)
+            append(p.arg(), p.value());
+    }
+
+    // Dopisuje punkt (a, v); a musi być większe od wszystkich argumentów,
+    // inaczej rzuca InvalidArg. Silna gwarancja. Zamortyzowane O(1).
+    void append(A const& a, V const& v);
+
+    const_iterator begin() const noexcept {
+        return const_iterator(this, 0);
+    }
+
+    const_iterator end() const noexcept {
+        return const_iterator(this, block_total());
+    }
+
+    // Iterator na punkt o argumencie a albo end(). O(log n + block_size).
+    const_iterator find(A const& a) const;
+
+    // Wartość w a; rzuca InvalidArg, jeśli a nie należy do dziedziny.
+    V value_at(A const& a) const {
+        const_iterator it = find(a);
+        if (it == end())
+            throw InvalidArg();
+        return it->value();
+    }
+
+    size_type size() const noexcept {
+        return blocks.size() * block_size + tail_args.size();
+    }
+
+    // Zwalnia zapas pamięci po zakończeniu dopisywania.
+    void shrink_to_fit() {
+        blocks.shrink_to_fit();
+        arg_bytes.shrink_to_fit();
+        value_words.shrink_to_fit();
+        tail_args.shrink_to_fit();
+        tail_values.shrink_to_fit();
+    }
+
+    // Zajmowana pamięć w bajtach (bez samego obiektu).
+    size_type memory_bytes() const noexcept {
+        return blocks.capacity() * sizeof(block) + arg_bytes.capacity()
+                + value_words.capacity() * sizeof(std::uint64_t)
+                + tail_args.capacity() * sizeof(A) + tail_values.capacity() * sizeof(V);
+    }
+
+    // Wywołuje fn(point_type const&) dla lokalnych maksimów o wartości nie
+    // mniejszej niż v, w kolejności argumentów. Bloki o maksimum mniejszym
+    // niż v są pomijane bez dekodowania.
+    template <typename F>
+    void for_each_maximum_at_least(V const& v, F&& fn) const {
+        scan_maxima(&v, fn);
+    }
+
+    // Wywołuje fn(point_type const&) dla wszystkich lokalnych maksimów,
+    // w kolejności argumentów.
+    template <typename F>
+    void for_each_maximum(F&& fn) const {
+        scan_maxima(nullptr, fn);
+    }
+
+    // Pierwsze maksimum w porządku FunctionMaxima (największa wartość,
+    // a wśród równych - najmniejszy argument) albo end(). Dekoduje tylko
+    // jeden blok.
+    const_iterator mx_top() const noexcept;
+
+private:
+    using U = std::make_unsigned_t<A>;
+
+    struct block {
+        A first_arg;
+        size_type arg_offset;    // w arg_bytes
+        size_type value_offset;  // w bitach, w value_words
+        V min, max;
+        unsigned width;          // bitów na wartość
+    };
+
+    std::vector<block> blocks;
+    std::vector<std::uint8_t> arg_bytes;
+    std::vector<std::uint64_t> value_words;
+    std::vector<A> tail_args;
+    std::vector<V> tail_values;
+    A last_arg{};  // ostatni argument w zamkniętych blokach
+
+    size_type block_total() const noexcept {
+        return blocks.size() + (tail_args.empty() ? 0 : 1);
+    }
+
+    size_type block_count(size_type b) const noexcept {
+        return b < blocks.size() ? block_size : tail_args.size();
+    }
+
+    V block_max(size_type b) const noexcept {
+        if (b < blocks.size())
+            return blocks[b].max;
+        V m = tail_values[0];
+        for (V const& x : tail_values)
+            m = m < x ? x : m;
+        return m;
+    }
+
+    U read_delta(size_type& byte) const noexcept {
+        U d = 0;
+        for (unsigned shift = 0;; shift += 7) {
+            std::uint8_t b = arg_bytes[byte++];
+            d |= static_cast<U>(b & 0x7f) << shift;
+            if (!(b & 0x80))
+                return d;
+        }
+    }
+
+    // Kod wartości: całkowite - przesunięcie względem minimum bloku,
+    // zmiennoprzecinkowe - ich bity.
+    static std::uint64_t encode(V const& v, V const& min) noexcept {
+        if constexpr (std::is_integral_v<V>) {
+            using UV = std::make_unsigned_t<V>;
+            return static_cast<UV>(static_cast<UV>(v) - static_cast<UV>(min));
+        } else {
+            std::uint64_t bits = 0;
+            std::memcpy(&bits, &v, sizeof(V));
+            return bits;
+        }
+    }
+
+    static V decode(std::uint64_t code, V const& min) noexcept {
+        if constexpr (std::is_integral_v<V>) {
+            using UV = std::make_unsigned_t<V>;
+            return static_cast<V>(static_cast<UV>(static_cast<UV>(min) + static_cast<UV>(code)));
+        } else {
+            V v;
+            std::memcpy(&v, &code, sizeof(V));
+            return v;
+        }
+    }
+
+    V value_of(size_type b, size_type i) const noexcept {
+        if (b >= blocks.size())
+            return tail_values[i];
+        block const& bl = blocks[b];
+        if (bl.width == 0)
+            return bl.min;
+        size_type bit = bl.value_offset + i * bl.width;
+        size_type word = bit / 64;
+        unsigned shift = bit % 64;
+        std::uint64_t code = value_words[word] >> shift;
+        if (shift + bl.width > 64)
+            code |= value_words[word + 1] << (64 - shift);
+        if (bl.width < 64)
+            code &= (std::uint64_t{1} << bl.width) - 1;
+        return decode(code, bl.min);
+    }
+
+    // Kompresuje pełny tail_args / tail_values do nowego bloku.
+    void seal();
+
+    // reserve dla extra nowych elementów z geometrycznym wzrostem.
+    template <typename T>
+    static void reserve_more(std::vector<T>& v, size_type extra) {
+        if (v.capacity() - v.size() < extra)
+            v.reserve(std::max(v.size() + extra, 2 * v.capacity()));
+    }
+
+    template <typename F>
+    void scan_maxima(V const* threshold, F& fn) const;
+};
+
+template <typename A, typename V>
+void CompressedFunctionMaxima<A, V>::append(A const& a, V const& v) {
+    if (size() > 0 && !((tail_args.empty() ? last_arg : tail_args.back()) < a))
+        throw InvalidArg();
+    tail_args.push_back(a);
+    try {
+        tail_values.push_back(v);
+        if (tail_args.size() == block_size)
+            seal();
+    } catch (...) {
+        tail_args.pop_back();
+        if (tail_values.size() > tail_args.size())
+            tail_values.pop_back();
+        throw;
+    }
+}
+
+template <typename A, typename V>
+void CompressedFunctionMaxima<A, V>::seal() {
+    block bl;
+    bl.first_arg = tail_args[0];
+    bl.arg_offset = arg_bytes.size();
+    bl.min = bl.max = tail_values[0];
+    for (V const& x : tail_values) {
+        bl.min = x < bl.min ? x : bl.min;
+        bl.max = bl.max < x ? x : bl.max;
+    }
+    if constexpr (std::is_integral_v<V>) {
+        bl.width = 0;
+        for (std::uint64_t range = encode(bl.max, bl.min); range != 0; range >>= 1)
+            ++bl.width;
+    } else {
+        bl.width = sizeof(V) * 8;
+    }
+    bl.value_offset = value_words.size() * 64;
+
+    std::vector<std::uint8_t> bytes;
+    bytes.reserve(block_size * 2);
+    for (size_type i = 1; i < block_size; ++i) {
+        U d = static_cast<U>(static_cast<U>(tail_args[i]) - static_cast<U>(tail_args[i - 1]));
+        for (; d >= 0x80; d >>= 7)
+            bytes.push_back(static_cast<std::uint8_t>(d | 0x80));
+        bytes.push_back(static_cast<std::uint8_t>(d));
+    }
+    std::vector<std::uint64_t> words((block_size * bl.width + 63) / 64, 0);
+    for (size_type i = 0; i < block_size && bl.width > 0; ++i) {
+        std::uint64_t code = encode(tail_values[i], bl.min);
+        size_type bit = i * bl.width;
+        words[bit / 64] |= code << (bit % 64);
+        if (bit % 64 + bl.width > 64)
+            words[bit / 64 + 1] |= code >> (64 - bit % 64);
+    }
+
+    // Rezerwujemy miejsce z góry, żeby dopisywanie już nie rzucało.
+    reserve_more(blocks, 1);
+    reserve_more(arg_bytes, bytes.size());
+    reserve_more(value_words, words.size());
+    last_arg = tail_args.back();
+    blocks.push_back(bl);
+    arg_bytes.insert(arg_bytes.end(), bytes.begin(), bytes.end());
+    value_words.insert(value_words.end(), words.begin(), words.end());
+    tail_args.clear();
+    tail_values.clear();
+}
+
+template <typename A, typename V>
+typename CompressedFunctionMaxima<A, V>::const_iterator
+CompressedFunctionMaxima<A, V>::find(A const& a) const {
+    const_iterator it;
+    it.c = this;
+    if (!tail_args.empty() && !(a < tail_args[0])) {
+        auto pos = std::lower_bound(tail_args.begin(), tail_args.end(), a);
+        if (pos == tail_args.end() || a < *pos)
+            return end();
+        it.block = blocks.size();
+        it.index = static_cast<size_type>(pos - tail_args.begin());
+        it.p.a = *pos;
+        it.p.v = tail_values[it.index];
+        return it;
+    }
+    // Ostatni blok o pierwszym argumencie nie większym niż a.
+    size_type lo = 0, hi = blocks.size();
+    while (lo < hi) {
+        size_type mid = lo + (hi - lo) / 2;
+        if (a < blocks[mid].first_arg)
+            hi = mid;
+        else
+            lo = mid + 1;
+    }
+    if (lo == 0)
+        return end();
+    // Dekodujemy same argumenty, a wartość tylko znalezionego punktu.
+    it.block = lo - 1;
+    it.byte = blocks[it.block].arg_offset;
+    A cur = blocks[it.block].first_arg;
+    for (it.index = 0; cur < a; ++it.index) {
+        if (it.index + 1 == block_size)
+            return end();
+        cur = static_cast<A>(static_cast<U>(cur) + read_delta(it.byte));
+    }
+    if (a < cur)
+        return end();
+    it.p.a = cur;
+    it.p.v = value_of(it.block, it.index);
+    return it;
+}
+
+template <typename A, typename V>
+template <typename F>
+void CompressedFunctionMaxima<A, V>::scan_maxima(V const* threshold, F& fn) const {
+    size_type total = block_total();
+    for (size_type b = 0; b < total; ++b) {
+        if (threshold && block_max(b) < *threshold)
+            continue;
+        size_type n = block_count(b);
+        bool has_prev = b > 0;
+        V prev = has_prev ? value_of(b - 1, block_count(b - 1) - 1) : V();
+        const_iterator it(this, b);
+        for (size_type i = 0; i < n; ++i, ++it) {
+            V const& v = it->value();
+            bool has_next = i + 1 < n || b + 1 < total;
+            bool is_max = (!has_prev || !(v < prev))
+                    && (!has_next || !(v < (i + 1 < n ? value_of(b, i + 1) : value_of(b + 1, 0))));
+            if (is_max && (!threshold || !(v < *threshold)))
+                fn(*it);
+            prev = v;
+            has_prev = true;
+        }
+    }
+}
+
+template <typename A, typename V>
+typename CompressedFunctionMaxima<A, V>::const_iterator
+CompressedFunctionMaxima<A, V>::mx_top() const noexcept {
+    size_type total = block_total();
+    if (total == 0)
+        return end();
+    size_type best = 0;
+    V best_max = block_max(0);
+    for (size_type b = 1; b < total; ++b) {
+        V m = block_max(b);
+        if (best_max < m) {
+            best = b;
+            best_max = m;
+        }
+    }
+    const_iterator it(this, best);
+    while (it->value() < best_max)
+        ++it;
+    return it;
+}
+
+#endif //MAKSIMA_COMPRESSED_FUNCTION_MAXIMA_H
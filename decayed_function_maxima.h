@@ -0,0 +1,170 @@
+#ifndef MAKSIMA_DECAYED_FUNCTION_MAXIMA_H
+#define MAKSIMA_DECAYED_FUNCTION_MAXIMA_H
+
+#include "function_maxima.h"
+
+#include <cmath>
+#include <limits>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// FunctionMaxima dla wartości wygasających wykładniczo: decay_all(factor)
+// mnoży wszystkie wartości przez ten sam dodatni czynnik. Mnożenie przez
+// liczbę dodatnią nie zmienia porządku wartości, więc przechowujemy
+// wartości względne r, a prawdziwa wartość to r * scale(). decay_all
+// zmienia tylko scale() w czasie O(1), a maksima pozostają poprawne bez
+// przeliczania. Nowe wartości są zapisywane jako v / scale(), więc dwie
+// wartości różniące się o mniej niż ulp mogą stać się równe.
+//
+// Gdy wykładnik skali oddali się od zera o więcej niż renormalize_exponent,
+// wartości względne (a z nimi nowo zapisywane v / scale()) groziłyby
+// nadmiarem albo niedomiarem. Wtedy mnożymy je wszystkie przez potęgę
+// dwójki, przenosząc ją ze skali: to mnożenie jest dokładne i ściśle
+// rosnące, więc FunctionMaxima::transform_values przebudowuje funkcję
+// w O(n). Tylko gdy któraś wartość straciłaby przy tym bity (wartości,
+// które wygasły do rzędu najmniejszych liczb typu V), budujemy funkcję od
+// nowa w O(n log n).
+template <typename A, typename V = double>
+class DecayedFunctionMaxima {
+    static_assert(std::is_floating_point_v<V>, "DecayedFunctionMaxima wymaga V zmiennoprzecinkowego");
+
+public:
+    // Wartości w punktach tej funkcji są względne.
+    using function_type = FunctionMaxima<A, V>;
+    using point_type = typename function_type::point_type;
+    using iterator = typename function_type::iterator;
+    using mx_iterator = typename function_type::mx_iterator;
+    using size_type = typename function_type::size_type;
+
+    static constexpr int renormalize_exponent = std::numeric_limits<V>::max_exponent / 4;
+
+    DecayedFunctionMaxima() = default;
+
+    // Prawdziwa wartość = wartość względna * scale().
+    V scale() const noexcept {
+        return scale_;
+    }
+
+    // Prawdziwa wartość w punkcie tej funkcji.
+    V actual(point_type const& p) const noexcept {
+        return p.value() * scale_;
+    }
+
+    // Prawdziwa wartość w a; rzuca InvalidArg, jeśli a nie należy do
+    // dziedziny.
+    V value_at(A const& a) const {
+        return f.value_at(a) * scale_;
+    }
+
+    // Ustawia prawdziwą wartość w a. Gdy v / scale() wyszłoby poza zakres V
+    // (albo niezerowe v stałoby się zerem), najpierw renormalizuje. Rzuca
+    // InvalidArg, gdy v nie da się zapisać nawet przy skali z [1, 2) (v
+    // nieskończone lub NaN). Silna gwarancja co do prawdziwych wartości;
+    // renormalizacja mogła się już odbyć.
+    void set_value(A const& a, V v) {
+        V r = v / scale_;
+        if (!std::isfinite(r) || (r == 0 && v != 0)) {
+            if (!std::isfinite(v / std::ldexp(scale_, -std::ilogb(scale_))))
+                throw InvalidArg();
+            renormalize();
+            r = v / scale_;
+        }
+        f.set_value(a, r);
+    }
+
+    void erase(A const& a) {
+        f.erase(a);
+    }
+
+    // Mnoży wszystkie wartości przez factor > 0 w czasie O(1), poza
+    // renormalizacją (O(n)). Rzuca InvalidArg dla czynnika niedodatniego lub
+    // nieskończonego. Silna gwarancja.
+    void decay_all(V factor) {
+        if (!(factor > 0) || !std::isfinite(factor))
+            throw InvalidArg();
+        V s = scale_ * factor;
+        if (s == 0 || !std::isfinite(s) || std::abs(std::ilogb(s)) > renormalize_exponent)
+            rescale(scale_, factor);
+        else
+            scale_ = s;
+    }
+
+    // Przenosi skalę do wartości względnych, tak by scale() trafiło do
+    // [1, 2). Silna gwarancja.
+    void renormalize() {
+        rescale(scale_, 1);
+    }
+
+    // Odczyty - bez żadnego przeliczania; wartości w punktach są względne.
+    function_type const& function() const noexcept {
+        return f;
+    }
+
+    iterator begin() const noexcept {
+        return f.begin();
+    }
+
+    iterator end() const noexcept {
+        return f.end();
+    }
+
+    iterator find(A const& a) const {
+        return f.find(a);
+    }
+
+    size_type size() const noexcept {
+        return f.size();
+    }
+
+    mx_iterator mx_begin() const noexcept {
+        return f.mx_begin();
+    }
+
+    mx_iterator mx_end() const noexcept {
+        return f.mx_end();
+    }
+
+    size_type mx_size() const noexcept {
+        return f.mx_size();
+    }
+
+private:
+    function_type f;
+    V scale_ = 1;
+
+    // Ustawia skalę scale * factor (liczoną bez pośredniego nadmiaru),
+    // mnożąc wartości względne przez 2^e, gdzie 2^e to rząd nowej skali.
+    void rescale(V scale, V factor);
+};
+
+template <typename A, typename V>
+void DecayedFunctionMaxima<A, V>::rescale(V scale, V factor) {
+    int e = std::ilogb(scale) + std::ilogb(factor);
+    V s = std::ldexp(scale, -std::ilogb(scale)) * std::ldexp(factor, -std::ilogb(factor));
+    e += std::ilogb(s);
+    s = std::ldexp(s, -std::ilogb(s));
+
+    bool exact = true;
+    for (point_type const& p : f) {
+        V r = std::ldexp(p.value(), e);
+        if (std::ldexp(r, -e) != p.value() || !std::isfinite(r)) {
+            exact = false;
+            break;
+        }
+    }
+    if (exact) {
+        f.transform_values([e](V r) { return std::ldexp(r, e); });
+    } else {
+        std::vector<std::pair<A, V>> points;
+        points.reserve(f.size());
+        for (point_type const& p : f)
+            points.emplace_back(p.arg(), std::ldexp(p.value(), e));
+        function_type rebuilt;
+        rebuilt.apply_batch(std::move(points));
+        f.swap(rebuilt);
+    }
+    scale_ = s;
+}
+
+#endif //MAKSIMA_DECAYED_FUNCTION_MAXIMA_H
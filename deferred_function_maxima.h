@@ -0,0 +1,135 @@
+#ifndef MAKSIMA_DEFERRED_FUNCTION_MAXIMA_H
+#define MAKSIMA_DEFERRED_FUNCTION_MAXIMA_H
+
+#include "function_maxima.h"
+
+#include <map>
+#include <optional>
+#include <utility>
+#include <vector>
+
+// FunctionMaxima z odroczonym utrzymywaniem maksimów. set_value i erase
+// tylko zapamiętują ostatnią zmianę dla argumentu w buforze oczekujących
+// zmian, więc wielokrotne aktualizacje tego samego argumentu między
+// odczytami kosztują tyle co wstawienie do std::map (argumenty mają jedynie
+// operator<, stąd mapa, a nie tablica haszująca). Bufor jest aplikowany
+// przez flush() albo przy pierwszym odczycie, który potrzebuje dziedziny
+// lub maksimów (mx_begin, begin, find, size, ...) - ustawienia jedną
+// paczką apply_batch, która sprawdza każde sąsiedztwo raz. value_at
+// odpowiada z bufora bez aplikowania go.
+template <typename A, typename V>
+class DeferredFunctionMaxima {
+public:
+    using function_type = FunctionMaxima<A, V>;
+    using point_type = typename function_type::point_type;
+    using iterator = typename function_type::iterator;
+    using mx_iterator = typename function_type::mx_iterator;
+    using size_type = typename function_type::size_type;
+
+    DeferredFunctionMaxima() = default;
+
+    explicit DeferredFunctionMaxima(function_type f) : fun(std::move(f)) {}
+
+    // Zapamiętuje f(a) = v. Silna gwarancja.
+    void set_value(A const& a, V const& v) {
+        auto it = pending.find(a);
+        if (it == pending.end()) {
+            pending.emplace(a, v);
+        } else {
+            std::optional<V> value(v);
+            std::swap(it->second, value);
+        }
+    }
+
+    // Zapamiętuje usunięcie a z dziedziny. Silna gwarancja.
+    void erase(A const& a) {
+        auto it = pending.find(a);
+        if (it == pending.end())
+            pending.emplace(a, std::nullopt);
+        else
+            it->second.reset();
+    }
+
+    // Wartość w a z uwzględnieniem oczekujących zmian; rzuca InvalidArg,
+    // jeśli a nie należy do dziedziny.
+    V const& value_at(A const& a) const {
+        auto it = pending.find(a);
+        if (it == pending.end())
+            return fun.value_at(a);
+        if (!it->second)
+            throw InvalidArg();
+        return *it->second;
+    }
+
+    // Aplikuje oczekujące zmiany. Jeśli zgłosi wyjątek, zmiany już
+    // zaaplikowane znikają z bufora, a pozostałe w nim zostają - widoczna
+    // zawartość funkcji się nie zmienia.
+    void flush() {
+        if (pending.empty())
+            return;
+        std::vector<std::pair<A, V>> batch;
+        std::vector<typename pending_map::iterator> sets, erases;
+        for (auto it = pending.begin(); it != pending.end(); ++it) {
+            if (it->second) {
+                batch.emplace_back(it->first, *it->second);
+                sets.push_back(it);
+            } else {
+                erases.push_back(it);
+            }
+        }
+        fun.apply_batch(std::move(batch));
+        for (auto it : sets)
+            pending.erase(it);
+        for (auto it : erases) {
+            fun.erase(it->first);
+            pending.erase(it);
+        }
+    }
+
+    // Liczba argumentów z oczekującymi zmianami.
+    size_type pending_size() const noexcept {
+        return pending.size();
+    }
+
+    // Odczyty dziedziny i maksimów - najpierw aplikują oczekujące zmiany.
+    function_type const& function() {
+        flush();
+        return fun;
+    }
+
+    iterator begin() {
+        return function().begin();
+    }
+
+    iterator end() {
+        return function().end();
+    }
+
+    iterator find(A const& a) {
+        return function().find(a);
+    }
+
+    size_type size() {
+        return function().size();
+    }
+
+    mx_iterator mx_begin() {
+        return function().mx_begin();
+    }
+
+    mx_iterator mx_end() {
+        return function().mx_end();
+    }
+
+    size_type mx_size() {
+        return function().mx_size();
+    }
+
+private:
+    using pending_map = std::map<A, std::optional<V>>;
+
+    function_type fun;
+    pending_map pending;
+};
+
+#endif //MAKSIMA_DEFERRED_FUNCTION_MAXIMA_H
@@ -5,14 +5,693 @@
 #include <set>
 #include <memory>
 #include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+#include <exception>
+#include <optional>
+#include <thread>
 
-class InvalidArg : std::exception {
+#ifdef MAKSIMA_LATENCY_HISTOGRAMS
+#include "latency_histogram.h"
+// Mierzy czas operacji op do końca bloku; patrz latency_histogram.h.
+#define MAKSIMA_LATENCY_SCOPE(op) \
+    maxima_latency::scope latency_scope(latency, maxima_latency::operation::op)
+#define MAKSIMA_LATENCY_RECLASSIFY(op) latency_scope.reclassify(maxima_latency::operation::op)
+#else
+#define MAKSIMA_LATENCY_SCOPE(op)
+#define MAKSIMA_LATENCY_RECLASSIFY(op)
+#endif
+
+class InvalidArg : public std::exception {
 public:
     [[nodiscard]] const char* what() const noexcept override {
         return "invalid argument value";
     }
 };
 
+// Polityki wykonania dla for_each_maximum i reduce_maxima. Nazwy
+// naśladują std::execution, ale nie dołączamy <execution> - w libstdc++
+// wciąga ono TBB i wymaga linkowania z nim nawet bez użycia algorytmów.
+namespace maxima_execution {
+
+struct sequenced_policy {};
+
+// threads == 0 oznacza std::thread::hardware_concurrency().
+struct parallel_policy {
+    unsigned threads = 0;
+
+    constexpr parallel_policy operator()(unsigned n) const noexcept {
+        return parallel_policy{n};
+    }
+};
+
+inline constexpr sequenced_policy seq{};
+inline constexpr parallel_policy par{};
+
+} // namespace maxima_execution
+
+namespace maxima_detail {
+
+// Węzeł drzewa bez przechowywanej wartości. Jako samodzielny obiekt służy
+// za strażnika (header): jego lewym synem jest korzeń, a zerowy rozmiar
+// odróżnia go od zwykłych węzłów.
+struct tree_node_base {
+    tree_node_base* left = nullptr;
+    tree_node_base* right = nullptr;
+    tree_node_base* parent = nullptr;
+    std::size_t size = 0;
+    std::uint32_t priority = 0;
+
+    bool is_header() const noexcept {
+        return size == 0;
+    }
+};
+
+template <typename T>
+struct tree_node : tree_node_base {
+    T value;
+    explicit tree_node(T const& v) : value(v) {}
+};
+
+// Drzewo przeszukiwań (treap), którego węzły znają rozmiar swojego
+// poddrzewa. Interfejsem naśladuje std::set: iteratory są stabilne,
+// insert daje silną gwarancję, a erase(iterator) jest noexcept. Dodatkowo
+// udostępnia statystyki pozycyjne (nth, rank) w czasie O(log n).
+// Porównanie musi być przezroczyste (is_transparent), bo wyszukujemy
+// zarówno po elementach, jak i po kluczach innych typów.
+template <typename T, typename Compare>
+class order_tree {
+    using base = tree_node_base;
+    using node = tree_node<T>;
+
+public:
+    using value_type = T;
+    using size_type = std::size_t;
+
+    class const_iterator {
+    private:
+        base* n = nullptr;
+        explicit const_iterator(base const* n) noexcept
+            : n(const_cast<base*>(n)) {}
+        friend class order_tree;
+    public:
+        using iterator_category = std::bidirectional_iterator_tag;
+        using value_type = T;
+        using difference_type = std::ptrdiff_t;
+        using pointer = T const*;
+        using reference = T const&;
+
+        const_iterator() noexcept = default;
+
+        reference operator*() const noexcept {
+            return static_cast<node*>(n)->value;
+        }
+        pointer operator->() const noexcept {
+            return &static_cast<node*>(n)->value;
+        }
+        const_iterator& operator++() noexcept {
+            n = successor(n);
+            return *this;
+        }
+        const_iterator operator++(int) noexcept {
+            const_iterator old = *this;
+            ++*this;
+            return old;
+        }
+        const_iterator& operator--() noexcept {
+            n = predecessor(n);
+            return *this;
+        }
+        const_iterator operator--(int) noexcept {
+            const_iterator old = *this;
+            --*this;
+            return old;
+        }
+        friend bool operator==(const_iterator x, const_iterator y) noexcept {
+            return x.n == y.n;
+        }
+        friend bool operator!=(const_iterator x, const_iterator y) noexcept {
+            return x.n != y.n;
+        }
+    };
+    using iterator = const_iterator;
+
+    order_tree() = default;
+
+    order_tree(order_tree const& other)
+        : comp(other.comp), seed(other.seed) {
+        set_root(clone(other.root(), &header));
+    }
+
+    order_tree(order_tree&& other) noexcept
+        : comp(other.comp), seed(other.seed) {
+        set_root(other.root());
+        other.header.left = nullptr;
+    }
+
+    order_tree& operator=(order_tree const& other) {
+        order_tree tmp(other);
+        swap(tmp);
+        return *this;
+    }
+
+    order_tree& operator=(order_tree&& other) noexcept {
+        order_tree tmp(std::move(other));
+        swap(tmp);
+        return *this;
+    }
+
+    ~order_tree() {
+        destroy(root());
+    }
+
+    void swap(order_tree& other) noexcept {
+        base* mine = root();
+        set_root(other.root());
+        other.set_root(mine);
+        std::swap(comp, other.comp);
+        std::swap(seed, other.seed);
+    }
+
+    const_iterator begin() const noexcept {
+        return root() ? const_iterator(leftmost(root())) : end();
+    }
+    const_iterator end() const noexcept {
+        return const_iterator(&header);
+    }
+    const_iterator cbegin() const noexcept {
+        return begin();
+    }
+    const_iterator cend() const noexcept {
+        return end();
+    }
+
+    size_type size() const noexcept {
+        return size_of(root());
+    }
+    bool empty() const noexcept {
+        return root() == nullptr;
+    }
+
+    // Pierwszy element nie mniejszy niż key.
+    template <typename K>
+    const_iterator lower_bound(K const& key) const {
+        base const* res = &header;
+        for (base const* t = root(); t != nullptr;) {
+            if (!comp(value_of(t), key)) {
+                res = t;
+                t = t->left;
+            } else {
+                t = t->right;
+            }
+        }
+        return const_iterator(res);
+    }
+
+    // Pierwszy element większy niż key.
+    template <typename K>
+    const_iterator upper_bound(K const& key) const {
+        base const* res = &header;
+        for (base const* t = root(); t != nullptr;) {
+            if (comp(key, value_of(t))) {
+                res = t;
+                t = t->left;
+            } else {
+                t = t->right;
+            }
+        }
+        return const_iterator(res);
+    }
+
+    template <typename K>
+    const_iterator find(K const& key) const {
+        const_iterator it = lower_bound(key);
+        if (it != end() && !comp(key, *it))
+            return it;
+        return end();
+    }
+
+    // k-ty (licząc od zera) element lub end(), jeśli k >= size().
+    const_iterator nth(size_type k) const noexcept {
+        if (k >= size())
+            return end();
+        base const* t = root();
+        for (;;) {
+            size_type s = size_of(t->left);
+            if (k < s) {
+                t = t->left;
+            } else if (k == s) {
+                return const_iterator(t);
+            } else {
+                k -= s + 1;
+                t = t->right;
+            }
+        }
+    }
+
+    // Liczba elementów poprzedzających it; dla end() jest to size().
+    size_type rank(const_iterator it) const noexcept {
+        base const* t = it.n;
+        if (t->is_header())
+            return size();
+        size_type r = size_of(t->left);
+        for (; !t->parent->is_header(); t = t->parent) {
+            if (t == t->parent->right)
+                r += size_of(t->parent->left) + 1;
+        }
+        return r;
+    }
+
+    // Wstawia v, o ile nie ma równoważnego elementu. Silna gwarancja.
+    std::pair<const_iterator, bool> insert(T const& v) {
+        const_iterator pos = lower_bound(v);
+        if (pos != end() && !comp(v, *pos))
+            return {pos, false};
+        return {insert_before(pos, v), true};
+    }
+
+    // Wstawia v bezpośrednio przed pos bez żadnych porównań; wołający
+    // odpowiada za zachowanie porządku. Może zgłosić jedynie wyjątek
+    // z alokacji lub kopiowania v - wtedy drzewo pozostaje niezmienione.
+    const_iterator insert_before(const_iterator pos, T const& v) {
+        node* nd = new node(v);
+        link_before(pos.n, nd);
+        return const_iterator(nd);
+    }
+
+    void erase(const_iterator it) noexcept {
+        unlink(it.n);
+        delete static_cast<node*>(it.n);
+    }
+
+    // Wstawia posortowany ciąg [first, last) bezpośrednio przed pos, bez
+    // porównań. Węzły tworzy w czasie O(k), a dołącza w O(log n) przez
+    // rozcięcie i sklejenie drzewa. Może zgłosić jedynie wyjątek z alokacji
+    // lub kopiowania elementów - wtedy drzewo pozostaje niezmienione.
+    // Zwraca iterator na pierwszy wstawiony element (pos, gdy ciąg pusty).
+    template <typename It>
+    const_iterator insert_sorted_before(const_iterator pos, It first, It last) {
+        base* block = build(first, last);
+        if (block == nullptr)
+            return pos;
+        base* begin_of_block = leftmost(block);
+        base* l;
+        base* r;
+        split(root(), rank(pos), l, r);
+        set_root(merge(merge(l, block), r));
+        return const_iterator(begin_of_block);
+    }
+
+    // Wstawia values[i] bezpośrednio przed positions[i] dla każdego i, bez
+    // porównań. Pozycje muszą być niemalejące, a elementy wstawiane przed
+    // tę samą pozycję - uporządkowane. Drzewo jest rozcinane na fragmenty
+    // między grupami pozycji, fragmenty są wypełniane równolegle
+    // (pool.parallel_for) i sklejane z powrotem. Może zgłosić jedynie
+    // wyjątek z alokacji lub kopiowania elementów - wtedy drzewo pozostaje
+    // niezmienione. Zwraca iteratory wstawionych elementów.
+    template <typename Pool>
+    std::vector<const_iterator> insert_before_parallel(
+            std::vector<const_iterator> const& positions, std::vector<T> const& values,
+            Pool& pool, size_type pieces) {
+        size_type m = values.size();
+        std::vector<const_iterator> inserted(m);
+        if (m == 0)
+            return inserted;
+        // Elementy wstawiane przed tę samą pozycję trafiają do jednego fragmentu.
+        std::vector<size_type> starts{0};
+        for (size_type j = 1; j < pieces; ++j) {
+            size_type s = j * m / pieces;
+            if (s <= starts.back())
+                continue;
+            while (s < m && positions[s] == positions[s - 1])
+                ++s;
+            if (s >= m)
+                break;
+            starts.push_back(s);
+        }
+        size_type count = starts.size();
+        std::vector<size_type> cuts(count);
+        for (size_type j = 1; j < count; ++j)
+            cuts[j] = rank(positions[starts[j]]);
+        std::vector<order_tree> parts(count);
+
+        // Od tego miejsca już bez alokacji aż do wypełniania fragmentów.
+        base* rest = root();
+        header.left = nullptr;
+        for (size_type j = count; j-- > 1;) {
+            base* l;
+            base* r;
+            split(rest, cuts[j], l, r);
+            rest = l;
+            parts[j].set_root(r);
+        }
+        parts[0].set_root(rest);
+        for (order_tree& part : parts) {
+            part.comp = comp;
+            part.seed = next_priority() | 1;
+        }
+
+        auto fill = [&](size_type j) {
+            order_tree& part = parts[j];
+            size_type first = starts[j];
+            size_type last = j + 1 < count ? starts[j + 1] : m;
+            size_type i = first;
+            try {
+                for (; i < last; ++i) {
+                    // Tylko ostatni fragment może dostać end() całego drzewa.
+                    base const* pos = positions[i].n == &header ? &part.header : positions[i].n;
+                    inserted[i] = part.insert_before(const_iterator(pos), values[i]);
+                }
+            } catch (...) {
+                while (i-- > first) {
+                    part.erase(inserted[i]);
+                    inserted[i] = const_iterator();
+                }
+                throw;
+            }
+        };
+        auto rejoin = [&]() noexcept {
+            base* all = nullptr;
+            for (order_tree& part : parts) {
+                all = merge(all, part.root());
+                part.header.left = nullptr;
+            }
+            set_root(all);
+        };
+        try {
+            pool.parallel_for(count, fill);
+        } catch (...) {
+            rejoin();
+            for (const_iterator it : inserted) {
+                if (it != const_iterator())
+                    erase(it);
+            }
+            throw;
+        }
+        rejoin();
+        return inserted;
+    }
+
+    void clear() noexcept {
+        destroy(root());
+        header.left = nullptr;
+    }
+
+private:
+    base header;
+    Compare comp;
+    std::uint32_t seed = 2463534242u;
+
+    base* root() const noexcept {
+        return header.left;
+    }
+
+    void set_root(base* r) noexcept {
+        header.left = r;
+        if (r)
+            r->parent = &header;
+    }
+
+    static T const& value_of(base const* t) noexcept {
+        return static_cast<node const*>(t)->value;
+    }
+
+    static size_type size_of(base const* t) noexcept {
+        return t ? t->size : 0;
+    }
+
+    static base* leftmost(base* t) noexcept {
+        while (t->left)
+            t = t->left;
+        return t;
+    }
+
+    static base* rightmost(base* t) noexcept {
+        while (t->right)
+            t = t->right;
+        return t;
+    }
+
+    static base* successor(base* t) noexcept {
+        if (t->right)
+            return leftmost(t->right);
+        base* p = t->parent;
+        while (!p->is_header() && t == p->right) {
+            t = p;
+            p = p->parent;
+        }
+        return p;
+    }
+
+    static base* predecessor(base* t) noexcept {
+        if (t->is_header())
+            return rightmost(t->left);
+        if (t->left)
+            return rightmost(t->left);
+        base* p = t->parent;
+        while (!p->is_header() && t == p->left) {
+            t = p;
+            p = p->parent;
+        }
+        return p;
+    }
+
+    std::uint32_t next_priority() noexcept {
+        // xorshift32
+        seed ^= seed << 13;
+        seed ^= seed >> 17;
+        seed ^= seed << 5;
+        return seed;
+    }
+
+    // Obraca krawędź między x a jego ojcem tak, że x zajmuje miejsce ojca.
+    static void rotate_up(base* x) noexcept {
+        base* p = x->parent;
+        base* g = p->parent;
+        if (x == p->left) {
+            p->left = x->right;
+            if (p->left)
+                p->left->parent = p;
+            x->right = p;
+        } else {
+            p->right = x->left;
+            if (p->right)
+                p->right->parent = p;
+            x->left = p;
+        }
+        p->parent = x;
+        x->parent = g;
+        if (g->is_header() || g->left == p)
+            g->left = x;
+        else
+            g->right = x;
+        x->size = p->size;
+        p->size = 1 + size_of(p->left) + size_of(p->right);
+    }
+
+    void link_before(base* pos, base* nd) noexcept {
+        nd->left = nd->right = nullptr;
+        nd->size = 1;
+        nd->priority = next_priority();
+        if (root() == nullptr) {
+            set_root(nd);
+            return;
+        }
+        if (pos->is_header()) {
+            base* last = rightmost(root());
+            last->right = nd;
+            nd->parent = last;
+        } else if (pos->left == nullptr) {
+            pos->left = nd;
+            nd->parent = pos;
+        } else {
+            base* prev = rightmost(pos->left);
+            prev->right = nd;
+            nd->parent = prev;
+        }
+        for (base* t = nd->parent; !t->is_header(); t = t->parent)
+            ++t->size;
+        while (!nd->parent->is_header() && nd->parent->priority < nd->priority)
+            rotate_up(nd);
+    }
+
+    void unlink(base* nd) noexcept {
+        while (nd->left || nd->right) {
+            base* child;
+            if (!nd->left)
+                child = nd->right;
+            else if (!nd->right)
+                child = nd->left;
+            else
+                child = nd->left->priority > nd->right->priority
+                        ? nd->left : nd->right;
+            rotate_up(child);
+        }
+        base* p = nd->parent;
+        if (p->is_header() || p->left == nd)
+            p->left = nullptr;
+        else
+            p->right = nullptr;
+        for (; !p->is_header(); p = p->parent)
+            --p->size;
+    }
+
+    static void update(base* t) noexcept {
+        t->size = 1 + size_of(t->left) + size_of(t->right);
+        if (t->left)
+            t->left->parent = t;
+        if (t->right)
+            t->right->parent = t;
+    }
+
+    // Dzieli t na k pierwszych elementów (l) i resztę (r).
+    static void split(base* t, size_type k, base*& l, base*& r) noexcept {
+        if (t == nullptr) {
+            l = r = nullptr;
+        } else if (size_of(t->left) >= k) {
+            split(t->left, k, l, t->left);
+            update(t);
+            r = t;
+        } else {
+            split(t->right, k - size_of(t->left) - 1, t->right, r);
+            update(t);
+            l = t;
+        }
+    }
+
+    // Skleja drzewa, gdy wszystkie elementy l poprzedzają elementy r.
+    static base* merge(base* l, base* r) noexcept {
+        if (l == nullptr)
+            return r;
+        if (r == nullptr)
+            return l;
+        if (l->priority > r->priority) {
+            l->right = merge(l->right, r);
+            update(l);
+            return l;
+        }
+        r->left = merge(l, r->left);
+        update(r);
+        return r;
+    }
+
+    static void fix_sizes(base* t) noexcept {
+        if (t == nullptr)
+            return;
+        fix_sizes(t->left);
+        fix_sizes(t->right);
+        update(t);
+    }
+
+    // Buduje samodzielne drzewo z posortowanego ciągu w czasie O(k):
+    // losuje priorytety i układa z nich drzewo kartezjańskie stosem.
+    template <typename It>
+    base* build(It first, It last) {
+        std::vector<base*> spine;
+        base* built = nullptr;
+        try {
+            for (; first != last; ++first) {
+                node* nd = new node(*first);
+                nd->priority = next_priority();
+                base* lower = nullptr;
+                while (!spine.empty() && spine.back()->priority < nd->priority) {
+                    lower = spine.back();
+                    spine.pop_back();
+                }
+                nd->left = lower;
+                if (spine.empty())
+                    built = nd;
+                else
+                    spine.back()->right = nd;
+                spine.push_back(nd);
+            }
+        } catch (...) {
+            destroy(built);
+            throw;
+        }
+        fix_sizes(built);
+        return built;
+    }
+
+    static base* clone(base const* t, base* parent) {
+        if (t == nullptr)
+            return nullptr;
+        node* nd = new node(value_of(t));
+        nd->size = t->size;
+        nd->priority = t->priority;
+        nd->parent = parent;
+        try {
+            nd->left = clone(t->left, nd);
+            nd->right = clone(t->right, nd);
+        } catch (...) {
+            destroy(nd->left);
+            delete nd;
+            throw;
+        }
+        return nd;
+    }
+
+    static void destroy(base* t) noexcept {
+        if (t == nullptr)
+            return;
+        destroy(t->left);
+        destroy(t->right);
+        delete static_cast<node*>(t);
+    }
+};
+
+// Pula "bez wątków": wykonuje zadania po kolei w wątku wołającym.
+struct inline_pool {
+    std::size_t concurrency() const noexcept {
+        return 1;
+    }
+
+    template <typename F>
+    void parallel_for(std::size_t n, F&& f) {
+        for (std::size_t i = 0; i < n; ++i)
+            f(i);
+    }
+};
+
+// Sortuje v stabilnie: fragmenty sortuje równolegle na puli, a potem
+// scala je parami, w każdej rundzie również równolegle.
+template <typename T, typename Compare, typename Pool>
+void parallel_stable_sort(std::vector<T>& v, Compare comp, Pool& pool, std::size_t pieces) {
+    std::size_t n = v.size();
+    if (pieces < 2 || n < 2 * pieces) {
+        std::stable_sort(v.begin(), v.end(), comp);
+        return;
+    }
+    std::size_t width = (n + pieces - 1) / pieces;
+    pool.parallel_for(pieces, [&](std::size_t j) {
+        std::size_t lo = std::min(n, j * width);
+        std::size_t hi = std::min(n, lo + width);
+        std::stable_sort(v.begin() + lo, v.begin() + hi, comp);
+    });
+    for (; width < n; width *= 2) {
+        std::size_t pairs = (n + 2 * width - 1) / (2 * width);
+        pool.parallel_for(pairs, [&](std::size_t j) {
+            std::size_t lo = j * 2 * width;
+            std::size_t mid = std::min(n, lo + width);
+            std::size_t hi = std::min(n, mid + width);
+            if (mid < hi)
+                std::inplace_merge(v.begin() + lo, v.begin() + mid, v.begin() + hi, comp);
+        });
+    }
+}
+
+} // namespace maxima_detail
+
+template <typename A, typename V>
+class LazyFunctionMaxima;
+
+template <typename A, typename V, typename Tolerance>
+class TolerantFunctionMaxima;
+
 template<typename A, typename V>
 class FunctionMaxima {
 public:
@@ -22,19 +701,20 @@ public:
     private:
         std::shared_ptr<A> arg_ptr;
         mutable std::shared_ptr<V> value_ptr;
-        explicit point_type(A arg, V value)
-            : arg_ptr(std::make_shared(arg)), value_ptr(std::make_shared(value)) {}
         // https://stackoverflow.com/a/17369971
         explicit point_type(const std::shared_ptr<A> arg, const std::shared_ptr<V> value)
             : arg_ptr(arg), value_ptr(value) {}
-        void replace_value(const std::shared_ptr<V>& new_value) const {
+        void replace_value(const std::shared_ptr<V>& new_value) const noexcept {
             value_ptr = new_value;
         }
         friend class FunctionMaxima;
+        friend class LazyFunctionMaxima<A, V>;
+        template <typename, typename, typename>
+        friend class TolerantFunctionMaxima;
     public:
         point_type(const point_type&) = default;
         point_type& operator=(const point_type&) = default;
-        // Zwraca a rgument funkcji.
+        // Zwraca argument funkcji.
         A const& arg() const noexcept {
             return *arg_ptr;
         }
@@ -49,13 +729,25 @@ public:
     };
 private:
     struct argument_order;
-    using function_set = std::set<point_type, argument_order>;
+    using function_set = maxima_detail::order_tree<point_type, argument_order>;
 
     struct maxima_order;
-    using maxima_set = std::set<point_type, maxima_order>;
+    using maxima_set = maxima_detail::order_tree<point_type, maxima_order>;
+
+    // Klucz wyszukiwania w maxima_set: granica między maksimami o wartości
+    // nie mniejszej niż v a pozostałymi.
+    struct value_bound {
+        V const& v;
+    };
 
+    // Każda wartość jest przechowywana raz; users to liczba punktów tej
+    // funkcji, które z niej korzystają.
+    struct range_entry {
+        std::shared_ptr<V> ptr;
+        mutable std::size_t users;
+    };
     struct range_order;
-    using range_set = std::set<std::weak_ptr<V>, range_order>;
+    using range_set = std::set<range_entry, range_order>;
     using rg_iterator = typename range_set::const_iterator;
 
     rg_iterator rg_end() const noexcept {
@@ -87,6 +779,7 @@ public:
     // Iterator, który wskazuje na punkt funkcji o argumencie a lub end(),
     // jeśli takiego argumentu nie ma w dziedzinie funkcji.
     iterator find(A const& a) const {
+        MAKSIMA_LATENCY_SCOPE(find);
         return fun.find(a);
     }
 
@@ -112,6 +805,134 @@ public:
         return fun.size();
     }
 
+    // Liczba lokalnych maksimów.
+    size_type mx_size() const noexcept {
+        return maxima.size();
+    }
+
+    // Przybliżona pamięć zajmowana przez dziedzinę, maksima i zbiór wartości
+    // w bajtach (bez samego obiektu i narzutu alokatora). Węzeł std::set
+    // liczymy jako cztery słowa, a blok make_shared jako dwa słowa liczników
+    // i sam obiekt.
+    size_type memory_bytes() const noexcept {
+        size_type word = sizeof(void*);
+        return (fun.size() + maxima.size()) * sizeof(maxima_detail::tree_node<point_type>)
+                + fun.size() * (2 * word + sizeof(A))
+                + range.size() * (4 * word + sizeof(range_entry) + 2 * word + sizeof(V));
+    }
+
+#ifdef MAKSIMA_LATENCY_HISTOGRAMS
+    // Histogramy czasów set_value, erase i find wykonanych na tym obiekcie.
+    maxima_latency::histograms const& latencies() const noexcept {
+        return latency.get();
+    }
+
+    void reset_latencies() noexcept {
+        latency.get().reset();
+    }
+#endif
+
+    // Statystyki pozycyjne, wszystkie w czasie O(log n):
+    // iterator na k-ty (licząc od zera) punkt w kolejności rosnących
+    // argumentów lub end(), jeśli k >= size()
+    iterator nth(size_type k) const noexcept {
+        return fun.nth(k);
+    }
+
+    // liczba punktów dziedziny o argumentach mniejszych niż a
+    size_type rank(A const& a) const {
+        return fun.rank(fun.lower_bound(a));
+    }
+
+    // iterator na k-te lokalne maksimum w kolejności od mx_begin()
+    // lub mx_end(), jeśli k >= mx_size()
+    mx_iterator mx_nth(size_type k) const noexcept {
+        return maxima.nth(k);
+    }
+
+    // Lekki zakres kolejnych lokalnych maksimów: para iteratorów i ich liczba.
+    class mx_range {
+    private:
+        mx_iterator first, last;
+        size_type count;
+        mx_range(mx_iterator first, mx_iterator last, size_type count) noexcept
+            : first(first), last(last), count(count) {}
+        friend class FunctionMaxima;
+    public:
+        mx_iterator begin() const noexcept {
+            return first;
+        }
+        mx_iterator end() const noexcept {
+            return last;
+        }
+        size_type size() const noexcept {
+            return count;
+        }
+        bool empty() const noexcept {
+            return count == 0;
+        }
+    };
+
+    // Lokalne maksima o wartościach nie mniejszych niż v. Ponieważ maksima
+    // są uporządkowane malejąco po wartościach, jest to prefiks
+    // mx_begin()..mx_end(), wyznaczany w czasie O(log k).
+    mx_range maxima_at_least(V const& v) const {
+        mx_iterator last = maxima.lower_bound(value_bound{v});
+        return mx_range(mx_begin(), last, maxima.rank(last));
+    }
+
+    // Woła f(arg, value) dla każdego lokalnego maksimum o wartości nie
+    // mniejszej niż v, w kolejności mx_iterator, bez kopiowania punktów.
+    template <typename F>
+    void for_each_maximum_at_least(V const& v, F&& f) const {
+        mx_iterator last = maxima.lower_bound(value_bound{v});
+        for (mx_iterator it = mx_begin(); it != last; ++it)
+            f(it->arg(), it->value());
+    }
+
+    // Woła fn(p) dla każdego lokalnego maksimum p. Z polityką
+    // maxima_execution::par maksima są dzielone (mx_nth) na spójne kawałki
+    // obsługiwane przez osobne wątki - fn jest wtedy wołane współbieżnie
+    // i w nieokreślonej kolejności. Wyjątek z fn trafia do wołającego po
+    // zakończeniu wszystkich wątków.
+    template <typename Policy, typename F>
+    void for_each_maximum(Policy policy, F&& fn) const {
+        std::vector<mx_iterator> bounds = mx_split(policy);
+        run_split(bounds, [&](size_type, mx_iterator first, mx_iterator last) {
+            for (; first != last; ++first)
+                fn(*first);
+        });
+    }
+
+    // Redukuje wartości lokalnych maksimów: init op v1 op v2 ... w kolejności
+    // od mx_begin(). Kawałki są redukowane niezależnie, a ich wyniki składane
+    // po kolei, więc op musi być łączne (przemienność nie jest potrzebna).
+    template <typename Policy, typename T, typename Op>
+    T reduce_maxima(Policy policy, T init, Op op) const {
+        return reduce_maxima(policy, std::move(init), std::move(op),
+                             [](point_type const& p) -> V const& { return p.value(); });
+    }
+
+    // Jak wyżej, ale redukuje proj(p) zamiast wartości.
+    template <typename Policy, typename T, typename Op, typename Proj>
+    T reduce_maxima(Policy policy, T init, Op op, Proj proj) const {
+        std::vector<mx_iterator> bounds = mx_split(policy);
+        std::vector<std::optional<T>> partial(bounds.size() - 1);
+        run_split(bounds, [&](size_type j, mx_iterator first, mx_iterator last) {
+            if (first == last)
+                return;
+            T acc = proj(*first);
+            for (++first; first != last; ++first)
+                acc = op(std::move(acc), proj(*first));
+            partial[j] = std::move(acc);
+        });
+        for (std::optional<T>& p : partial) {
+            if (p)
+                init = op(std::move(init), std::move(*p));
+        }
+        return init;
+    }
+
     // Konstruktor bezparametrowy (tworzy funkcję o pustej dziedzinie),
     //  konstruktor kopiujący i operator=. Dwa ostatnie powinny mieć
     //  sensowne działanie.
@@ -119,6 +940,14 @@ public:
     FunctionMaxima(const FunctionMaxima&) = default;
     FunctionMaxima& operator=(const FunctionMaxima&) = default;
 
+    // Wymienia zawartość z other w czasie O(1); iteratory pozostają ważne
+    // i wskazują na elementy other.
+    void swap(FunctionMaxima& other) noexcept {
+        fun.swap(other.fun);
+        maxima.swap(other.maxima);
+        range.swap(other.range);
+    }
+
     // Zwraca wartość w punkcie a, rzuca wyjątek InvalidArg, jeśli a nie
     // należy do dziedziny funkcji. Złożoność najwyżej O(log n).
     V const& value_at(A const& a) const {
@@ -137,55 +966,156 @@ public:
     // nie dzieje się nic. Złożoność najwyżej O(log n).
     void erase(const A&);
 
+    // Dodaje delta do wartości wszystkich punktów o argumentach z przedziału
+    // [lo, hi]. Dodawanie nie odwraca porządku wartości, ale może go
+    // spłaszczyć (dla liczb zmiennoprzecinkowych 1e16 < 1e16 + 2, a po
+    // dodaniu 1.0 obie są równe), więc status każdego punktu wnętrza
+    // wyznaczamy ponownie z nowych wartości; skrajne punkty porównujemy też
+    // z zewnętrznymi sąsiadami. Złożoność O(k + m log n), gdzie k to liczba
+    // punktów, a m liczba lokalnych maksimów w przedziale przed zmianą i po
+    // niej (te zmieniają pozycję w porządku maksimów). Wymaga V + V.
+    void add_to_range(A const& lo, A const& hi, V const& delta);
+
+    // Nadaje wszystkim punktom o argumentach z przedziału [lo, hi] wartość v.
+    // Wnętrze przedziału staje się płaskowyżem, którego punkty są lokalnymi
+    // maksimami tworzącymi spójny blok w porządku maksimów - wstawiamy go
+    // jednym sklejeniem. Ponownie sprawdzamy tylko skrajne punkty i ich
+    // zewnętrznych sąsiadów. Złożoność O(k + m log n), gdzie k to liczba
+    // punktów, a m liczba dotychczasowych maksimów w przedziale.
+    void assign_range(A const& lo, A const& hi, V const& v);
+
+    // Zastępuje każdą wartość v przez f(v). f musi być ściśle rosnąca na
+    // wartościach funkcji - wtedy porządek wartości, a więc zbiór lokalnych
+    // maksimów i ich kolejność, się nie zmienia i wszystkie struktury
+    // przebudowujemy w czasie O(n) bez porównywania argumentów. Silna
+    // gwarancja.
+    template <typename F>
+    void transform_values(F f);
+
+    // Zastępuje zawartość funkcji punktami z [first, last) - parami (a, v)
+    // o ściśle rosnących argumentach (np. z pliku lub innej posortowanej
+    // struktury). Drzewa budujemy bez wyszukiwań: dziedzinę w czasie O(n),
+    // a wartości i maksima sortujemy w wektorach. Silna gwarancja.
+    template <typename It>
+    void assign_sorted(It first, It last);
+
+    // Daje ten sam wynik co wywołanie set_value po kolei dla elementów batch
+    // (przy powtórzonym argumencie wygrywa ostatnie wystąpienie), ale
+    // większość pracy wykonuje równolegle na puli pool, która musi mieć
+    // concurrency() i parallel_for(n, f) (np. WorkStealingPool). Lokalne
+    // maksima zmieniają się tylko w punktach paczki i ich sąsiadach, więc
+    // posortowaną paczkę dzielimy na kawałki: wyszukiwania i nowe statusy
+    // liczymy niezależnie dla kawałków (sąsiada z sąsiedniego kawałka
+    // odczytujemy z jego wyliczonych już pozycji), drzewa rozcinamy na
+    // fragmenty i wypełniamy je równolegle, a potem sklejamy. Sekwencyjnie
+    // dodajemy tylko nowe wartości do zbioru wartości. Silna gwarancja dla
+    // całej paczki. Wymaga, by A i V dawały się przenosić i przypisywać.
+    template <typename Pool>
+    void apply_parallel(std::vector<std::pair<A, V>> batch, Pool& pool);
+
+    // apply_parallel w wątku wołającym: każde sąsiedztwo zmienionych punktów
+    // jest sprawdzane raz dla całej paczki.
+    void apply_batch(std::vector<std::pair<A, V>> batch) {
+        maxima_detail::inline_pool pool;
+        apply_parallel(std::move(batch), pool);
+    }
+
 private:
+    // Utrzymuje fun i range jak FunctionMaxima, a maxima leniwie.
+    friend class LazyFunctionMaxima<A, V>;
+    // Utrzymuje fun i range jak FunctionMaxima, a maksima we własnym zbiorze.
+    template <typename, typename, typename>
+    friend class TolerantFunctionMaxima;
+
     function_set fun;
     maxima_set maxima;
     range_set range;
+#ifdef MAKSIMA_LATENCY_HISTOGRAMS
+    maxima_latency::recorder latency;
+#endif
 
-    // nie moje wersje ~Wojciech
-    //Pomocnicze funkcje, określające czy
-    //w danym miejscu jest maximum lokalne
-    bool left_checker(iterator it){
-        if (it == fun.cbegin()) return true;
-        iterator left = std::prev(it);
-        return !(it->value() < left->value()); //możliwy wyjątek w >
+    // Pomocnicze funkcje, określające czy punkt it nie jest mniejszy
+    // od swojego obecnego lewego (prawego) sąsiada.
+    bool left_check(iterator it) const {
+        if (it == fun.begin())
+            return true;
+        return !(it->value() < std::prev(it)->value()); //możliwy wyjątek w <
     }
-    bool right_checker(iterator it){
+    bool right_check(iterator it) const {
         iterator right = std::next(it);
-        if (right == fun.cend()) return true;
-        return !(it->value() < right->value()); //możliwy wyjątek w >
+        if (right == fun.end())
+            return true;
+        return !(it->value() < right->value()); //możliwy wyjątek w <
     }
 
-    bool maximum_check(iterator it){
-        return left_checker(it) && right_checker(it); //dziedziczy wyjatki
+    // Granice kawałków maksimów dla polityki: kawałek j to
+    // [bounds[j], bounds[j + 1]). Kawałki mają co najmniej 1024 maksima.
+    static unsigned policy_threads(maxima_execution::sequenced_policy) noexcept {
+        return 1;
+    }
+    static unsigned policy_threads(maxima_execution::parallel_policy p) noexcept {
+        unsigned n = p.threads ? p.threads : std::thread::hardware_concurrency();
+        return n ? n : 1;
+    }
+    template <typename Policy>
+    std::vector<mx_iterator> mx_split(Policy policy) const {
+        size_type n = mx_size();
+        size_type t = std::max<size_type>(1, std::min<size_type>(policy_threads(policy), n / 1024));
+        std::vector<mx_iterator> bounds(t + 1, mx_end());
+        for (size_type j = 0; j < t; ++j)
+            bounds[j] = mx_nth(j * n / t);
+        return bounds;
     }
 
-
-    // Moje wersje ~Wojciech
-    bool left_check(iterator it, iterator to_erase) const {
-        if (it == fun.begin())
-            return true;
-        iterator left = std::prev(it);
-        if (left == to_erase) {
-            if (left == fun.begin())
-                return true;
-            else
-                --left;
+    // Wykonuje chunk(j, first, last) dla każdego kawałka; pierwszy kawałek
+    // w wątku wołającym, pozostałe w nowych wątkach.
+    template <typename F>
+    static void run_split(std::vector<mx_iterator> const& bounds, F&& chunk) {
+        size_type t = bounds.size() - 1;
+        if (t == 1) {
+            chunk(0, bounds[0], bounds[1]);
+            return;
         }
-        return !(it->value() < left->value()); //możliwy wyjątek w <
-    }
-    bool right_check(iterator it, iterator to_erase) const {
-        iterator right = std::next(it);
-        if (right == fun.end())
-            return true;
-        if (right == to_erase) {
-            if (++right == fun.end())
-                return true;
+        std::vector<std::exception_ptr> errors(t);
+        auto run = [&](size_type j) {
+            try {
+                chunk(j, bounds[j], bounds[j + 1]);
+            } catch (...) {
+                errors[j] = std::current_exception();
+            }
+        };
+        std::vector<std::thread> workers;
+        workers.reserve(t - 1);
+        try {
+            for (size_type j = 1; j < t; ++j)
+                workers.emplace_back(run, j);
+        } catch (...) {
+            for (std::thread& w : workers)
+                w.join();
+            throw;
+        }
+        run(0);
+        for (std::thread& w : workers)
+            w.join();
+        for (std::exception_ptr const& e : errors) {
+            if (e)
+                std::rethrow_exception(e);
         }
-        return !(it->value() < right->value()); //możliwy wyjątek w <
     }
-    bool is_maximum(iterator it, iterator to_erase = nullptr) const {
-        return left_check(it, to_erase) && right_check(it, to_erase);
+
+    // Zwraca wpis w zbiorze wartości równy v, dodając go w razie potrzeby.
+    // Drugi element pary mówi, czy wpis jest nowy. Silna gwarancja.
+    std::pair<rg_iterator, bool> intern(V const& v) {
+        rg_iterator it = rg_find(v);
+        if (it != rg_end())
+            return {it, false};
+        return range.insert(range_entry{std::make_shared<V>(v), 0});
+    }
+
+    // Oddaje wpis w zbiorze wartości przez jednego z punktów.
+    void release(rg_iterator it) noexcept {
+        if (--it->users == 0)
+            range.erase(it);
     }
 };
 
@@ -207,245 +1137,663 @@ struct FunctionMaxima<A, V>::argument_order {
 
 template <typename A, typename V>
 struct FunctionMaxima<A, V>::maxima_order {
+    using is_transparent = void;
     bool operator()(const point_type& x, const point_type& y) const {
-        return y.value() < x.value() || (!(y.value() < x.value()) && x.arg() < y.arg());
+        return y.value() < x.value() || (!(x.value() < y.value()) && x.arg() < y.arg());
+    }
+    bool operator()(const point_type& x, const value_bound& y) const {
+        return !(x.value() < y.v);
+    }
+    bool operator()(const value_bound& x, const point_type& y) const {
+        return y.value() < x.v;
     }
 };
 
 template <typename A, typename V>
 struct FunctionMaxima<A, V>::range_order {
     using is_transparent = void;
-    bool operator()(const std::weak_ptr<V> x, const std::weak_ptr<V> y) const {
-        assert(!x.expired() && !y.expired());
-        return *x.lock() < *y.lock();
+    bool operator()(const range_entry& x, const range_entry& y) const {
+        return *x.ptr < *y.ptr;
     }
-    bool operator()(const V& x, const std::weak_ptr<V> y) const {
-        assert(!y.expired());
-        return x < *y.lock();
+    bool operator()(const V& x, const range_entry& y) const {
+        return x < *y.ptr;
     }
-    bool operator()(const std::weak_ptr<V> x, const V& y) const {
-        assert(!x.expired());
-        return *x.lock() < y;
+    bool operator()(const range_entry& x, const V& y) const {
+        return *x.ptr < y;
     }
 };
 
 template <typename A, typename V>
 void FunctionMaxima<A, V>::set_value(A const& a, V const& v) {
-    iterator it = find(a);
-    //v = stara wartosc
-    if (it != fun.cend() && !(it->value() < v) 
-        && !(v < it->value())) return ;
-
-    rg_iterator v_ptr_old = rg_find(it->value());
-    rg_iterator new_val_it = rg_find(v);
-    bool new_value = new_val_it != rg_end();
-
-    bool found = it != fun.end();
-    mx_iterator max_position = maxima.cend();
-    mx_iterator max_position_r = maxima.cend();
-    mx_iterator max_position_l = maxima.cend();
-
-    std::shared_ptr<A> a_ptr = found
-            ? it->arg_ptr
-            : std::make_shared<A>(static_cast<A>(a));
-    std::shared_ptr<V> v_ptr = new_value
-            ? new_val_it->lock()
-            : std::make_shared<V>(static_cast<V>(v));
-
-    auto val_ins = range.insert(v_ptr);
-    new_val_it = val_ins.first;
-    bool val_ins_true = val_ins.second;
-    
-
-    //f(a) = v
-    if (found)
-        it->replace_value(v_ptr); 
-    else
-        it = fun.insert(point_type{a_ptr, v_ptr}).first;
-
-    max_position = maxima.find(*it);
-
-    bool was_maximum = max_position != mx_end();
-    bool was_maximum_l = false, was_maximum_r = false;
-
-    iterator left = fun.cend(), right = fun.cend();
-    bool left_exist = it != fun.cbegin();
-    bool right_exist = std::next(it) != fun.cend();
-
-    if(left_exist) left = std::prev(it);
-    if(right_exist) right = std::next(it);
-
-    bool will_be_max = maximum_check(it);
-    bool will_be_max_l = left_exist ? false : right_checker(left);
-    bool will_be_max_r = right_exist ? false : left_checker(right);
-
-    try{
-        if (left_exist){
-            max_position_l = maxima.find(*left);
-            was_maximum_l = max_position_l != maxima.cend();
-        }
-        if (right_exist){
-            max_position_r = maxima.find(*right); 
-            was_maximum_r = max_position_r != maxima.cend();
-        }
-    }
-    catch(...){
-        if (found)
-            it->replace_value(v_ptr_old->lock());
-        else
-            fun.erase(it);
-
-        if(val_ins_true)
-            range.erase(new_val_it);
-        throw;
+    MAKSIMA_LATENCY_SCOPE(set_new);
+    // Najpierw wszystkie porównania (mogą zgłosić wyjątek), bez modyfikacji.
+    iterator right = fun.lower_bound(a);
+    bool found = right != end() && !(a < right->arg());
+    iterator it = found ? right : end();
+    if (found) {
+        MAKSIMA_LATENCY_RECLASSIFY(set_existing);
+        //v = stara wartosc
+        if (!(it->value() < v) && !(v < it->value()))
+            return;
+        ++right;
     }
-    
-    //określanie co ma się zdarzyć
-    bool should_be_erased = false;
-    bool should_be_erased_l = false;
-    bool should_be_erased_r = false;
+    iterator left = end();
+    if ((found ? it : right) != begin())
+        left = std::prev(found ? it : right);
+    bool left_exist = left != end();
+    bool right_exist = right != end();
 
-    bool should_be_inserted = false;
-    bool should_be_inserted_l = false;
-    bool should_be_inserted_r = false;
+    bool will_be_max = (!left_exist || !(v < left->value()))
+            && (!right_exist || !(v < right->value()));
+    bool will_be_max_l = left_exist && left_check(left) && !(left->value() < v);
+    bool will_be_max_r = right_exist && right_check(right) && !(right->value() < v);
 
-    if (will_be_max){
-        if (was_maximum)
-            max_position->replace_value(v_ptr);
-        else
-            should_be_inserted = true;}
-    else if (was_maximum)
-        should_be_erased = true;
+    mx_iterator max_position = found ? maxima.find(*it) : mx_end();
+    mx_iterator max_position_l = left_exist ? maxima.find(*left) : mx_end();
+    mx_iterator max_position_r = right_exist ? maxima.find(*right) : mx_end();
+    rg_iterator v_old = found ? rg_find(it->value()) : rg_end();
 
-    if(left_exist){
-        if (will_be_max_l && !was_maximum_l)
-            should_be_inserted_l = true;
-        else if (!will_be_max_l && was_maximum_l)
-            should_be_erased_l = true;
-    }
-    if(right_exist){
-        if (will_be_max_r && !was_maximum_r)
-            should_be_inserted_r = true;
-        else if (!will_be_max_r && was_maximum_r)
-            should_be_erased_r = true;
-    }
+    // Modyfikacje; każda daje silną gwarancję, a w razie wyjątku cofamy
+    // wcześniejsze (operacjami noexcept).
+    std::shared_ptr<A> a_ptr = found ? it->arg_ptr : std::make_shared<A>(a);
+    auto [v_new, v_inserted] = intern(v);
+    point_type new_point{a_ptr, v_new->ptr};
 
     //iteratory do bezpiecznego cofania insercji
+    iterator inserted_fun = end();
     mx_iterator inserted = mx_end();
     mx_iterator inserted_l = mx_end();
     mx_iterator inserted_r = mx_end();
+    try {
+        if (!found)
+            inserted_fun = fun.insert_before(right, new_point);
+        if (will_be_max)
+            inserted = maxima.insert(new_point).first;
+        if (will_be_max_l && max_position_l == mx_end())
+            inserted_l = maxima.insert(*left).first;
+        if (will_be_max_r && max_position_r == mx_end())
+            inserted_r = maxima.insert(*right).first;
+    } catch (...) {
+        if (inserted_r != mx_end())
+            maxima.erase(inserted_r);
+        if (inserted_l != mx_end())
+            maxima.erase(inserted_l);
+        if (inserted != mx_end())
+            maxima.erase(inserted);
+        if (inserted_fun != end())
+            fun.erase(inserted_fun);
+        if (v_inserted)
+            range.erase(v_new);
+        throw;
+    }
 
-    bool done = false;
-    bool done_l = false;
-    bool done_r = false;
-                
-    //insercje maximów
-    try {//aktualizowanie głównego
-        if(should_be_inserted){
-            inserted = maxima.insert(*it).first;
-            done = true;
-        }    
-        try{//aktualizowanie lewego
-            if(should_be_inserted_l){
-                inserted_l = maxima.insert(*left).first;
-                done_l = true;
-            }  
-            try{//aktualizowanie prawego
-                if(should_be_inserted_r){
-                    inserted_r = maxima.insert(*right).first;
-                    done_r = true;
-                }  
-            }
-            catch(...){
-                //cofanie prawego
-                 if(should_be_inserted_r && done_r)
-                    maxima.erase(inserted_r);
-                throw;
-            }
-        }
-        catch(...)
-        {   //cofanie lewego
-            if(should_be_inserted_l && done_l)
+    // Zatwierdzenie - już tylko operacje noexcept.
+    ++v_new->users;
+    if (found) {
+        it->replace_value(v_new->ptr);
+        release(v_old);
+    }
+    if (max_position != mx_end())
+        maxima.erase(max_position);
+    if (!will_be_max_l && max_position_l != mx_end())
+        maxima.erase(max_position_l);
+    if (!will_be_max_r && max_position_r != mx_end())
+        maxima.erase(max_position_r);
+}
+
+template <typename A, typename V>
+void FunctionMaxima<A, V>::erase(A const& a) {
+    MAKSIMA_LATENCY_SCOPE(erase);
+    iterator to_erase = fun.find(a);
+    if (to_erase == end())
+        return;
+
+    iterator left = to_erase == begin() ? end() : std::prev(to_erase);
+    iterator right = std::next(to_erase);
+    bool left_exist = left != end();
+    bool right_exist = right != end();
+
+    // Po usunięciu left i right zostaną sąsiadami.
+    bool will_be_max_l = left_exist && left_check(left)
+            && (!right_exist || !(left->value() < right->value()));
+    bool will_be_max_r = right_exist && right_check(right)
+            && (!left_exist || !(right->value() < left->value()));
+
+    mx_iterator mx_it = maxima.find(*to_erase);
+    mx_iterator left_mx = left_exist ? maxima.find(*left) : mx_end();
+    mx_iterator right_mx = right_exist ? maxima.find(*right) : mx_end();
+    rg_iterator rg_it = rg_find(to_erase->value());
+    assert(rg_it != rg_end());
+
+    mx_iterator inserted_l = mx_end(), inserted_r = mx_end();
+    try {
+        if (will_be_max_l && left_mx == mx_end())
+            inserted_l = maxima.insert(*left).first;
+        if (will_be_max_r && right_mx == mx_end())
+            inserted_r = maxima.insert(*right).first;
+    } catch (...) {
+        if (inserted_l != mx_end())
             maxima.erase(inserted_l);
-            throw;
-        }
+        throw;
     }
-    catch (...) {
-        //cofanie głównego
-        if(should_be_inserted && done)
-            maxima.erase(inserted);
 
-        //przywracanie wartości
-        if (found)
-            it->replace_value(v_ptr_old->lock());
-        else
-            fun.erase(it);
+    if (mx_it != mx_end())
+        maxima.erase(mx_it);
+    if (!will_be_max_l && left_mx != mx_end())
+        maxima.erase(left_mx);
+    if (!will_be_max_r && right_mx != mx_end())
+        maxima.erase(right_mx);
+    fun.erase(to_erase);
+    release(rg_it);
+}
+
+template <typename A, typename V>
+void FunctionMaxima<A, V>::add_to_range(A const& lo, A const& hi, V const& delta) {
+    if (hi < lo)
+        return;
+    iterator first = fun.lower_bound(lo);
+    iterator last = fun.upper_bound(hi);
+    if (first == last)
+        return;
+    iterator outer_l = first == begin() ? end() : std::prev(first);
+    iterator outer_r = last;
 
-        if (will_be_max && was_maximum)
-            max_position->replace_value(v_ptr_old->lock());
+    std::vector<iterator> points;
+    std::vector<rg_iterator> old_values, new_values;
+    std::vector<rg_iterator> fresh;
+    std::vector<point_type> to_insert;
+    std::vector<mx_iterator> to_erase, inserted;
+    // Wartości są współdzielone, więc każdą z nich przesuwamy tylko raz.
+    std::unordered_map<V const*, std::pair<rg_iterator, rg_iterator>> shifted;
+    try {
+        for (iterator it = first; it != last; ++it) {
+            auto known = shifted.find(&it->value());
+            if (known == shifted.end()) {
+                rg_iterator old_value = rg_find(it->value());
+                auto [new_value, is_fresh] = intern(it->value() + delta);
+                if (is_fresh)
+                    fresh.push_back(new_value);
+                known = shifted.emplace(&it->value(),
+                                        std::make_pair(old_value, new_value)).first;
+            }
+            points.push_back(it);
+            old_values.push_back(known->second.first);
+            new_values.push_back(known->second.second);
+        }
 
-        if(val_ins_true)
-            range.erase(new_val_it);
+        size_type k = points.size();
+        // Nowa wartość i-tego punktu przedziału; -1 i k to zewnętrzni sąsiedzi.
+        auto nv = [&](std::ptrdiff_t i) -> V const* {
+            if (i < 0)
+                return outer_l != end() ? &outer_l->value() : nullptr;
+            if (static_cast<size_type>(i) >= k)
+                return outer_r != end() ? &outer_r->value() : nullptr;
+            return new_values[i]->ptr.get();
+        };
+        auto will_be_max = [&](std::ptrdiff_t i) {
+            V const* l = nv(i - 1);
+            V const* r = nv(i + 1);
+            return (!l || !(*nv(i) < *l)) && (!r || !(*nv(i) < *r));
+        };
+        auto reposition = [&](size_type i, bool was_max, mx_iterator old_mx, bool will) {
+            // Ta sama wartość - wpis w maksimach pozostaje ważny.
+            if (was_max && will && old_values[i] == new_values[i])
+                return;
+            if (was_max)
+                to_erase.push_back(old_mx);
+            if (will)
+                to_insert.push_back(point_type{points[i]->arg_ptr, new_values[i]->ptr});
+        };
 
+        // Wnętrze przedziału: zwykle status się nie zmienia i tylko
+        // przesuwamy maksima, ale równe po dodaniu wartości mogą utworzyć
+        // nowy płaskowyż.
+        for (size_type i = 1; i + 1 < k; ++i) {
+            bool was_max = left_check(points[i]) && right_check(points[i]);
+            bool will = will_be_max(static_cast<std::ptrdiff_t>(i));
+            if (was_max || will)
+                reposition(i, was_max, was_max ? maxima.find(*points[i]) : mx_end(), will);
+        }
+        // Skrajne punkty przedziału.
+        mx_iterator mx_first = maxima.find(*points[0]);
+        reposition(0, mx_first != mx_end(), mx_first, will_be_max(0));
+        if (k > 1) {
+            mx_iterator mx_last = maxima.find(*points[k - 1]);
+            reposition(k - 1, mx_last != mx_end(), mx_last, will_be_max(k - 1));
+        }
+        // Zewnętrzni sąsiedzi.
+        if (outer_l != end()) {
+            mx_iterator mx_l = maxima.find(*outer_l);
+            bool will = left_check(outer_l) && !(outer_l->value() < *nv(0));
+            if (will && mx_l == mx_end())
+                to_insert.push_back(*outer_l);
+            else if (!will && mx_l != mx_end())
+                to_erase.push_back(mx_l);
+        }
+        if (outer_r != end()) {
+            mx_iterator mx_r = maxima.find(*outer_r);
+            bool will = right_check(outer_r) && !(outer_r->value() < *nv(k - 1));
+            if (will && mx_r == mx_end())
+                to_insert.push_back(*outer_r);
+            else if (!will && mx_r != mx_end())
+                to_erase.push_back(mx_r);
+        }
+
+        inserted.reserve(to_insert.size());
+        for (point_type const& p : to_insert)
+            inserted.push_back(maxima.insert(p).first);
+    } catch (...) {
+        for (mx_iterator mx_it : inserted)
+            maxima.erase(mx_it);
+        for (rg_iterator rg_it : fresh)
+            range.erase(rg_it);
         throw;
     }
 
-    //erasy maximow
-    if(should_be_erased)
-        maxima.erase(max_position);
-    if(should_be_erased_l)
-        maxima.erase(max_position_l);
-    if(should_be_erased_r)
-        maxima.erase(max_position_r);
+    // Zatwierdzenie. Najpierw wszystkie nowe odwołania do wartości, dopiero
+    // potem zwalnianie starych - nowa wartość jednego punktu może być starą
+    // wartością innego.
+    for (rg_iterator rg_it : new_values)
+        ++rg_it->users;
+    for (size_type i = 0; i < points.size(); ++i) {
+        points[i]->replace_value(new_values[i]->ptr);
+        release(old_values[i]);
+    }
+    for (mx_iterator mx_it : to_erase)
+        maxima.erase(mx_it);
+}
 
-    //usuwanie ze zbioru wartości
-    if (v_ptr_old->expired())
-            range.erase(v_ptr_old);
+template <typename A, typename V>
+void FunctionMaxima<A, V>::assign_range(A const& lo, A const& hi, V const& v) {
+    if (hi < lo)
+        return;
+    iterator first = fun.lower_bound(lo);
+    iterator last = fun.upper_bound(hi);
+    if (first == last)
+        return;
+    iterator outer_l = first == begin() ? end() : std::prev(first);
+    iterator outer_r = last;
+    bool left_exist = outer_l != end();
+    bool right_exist = outer_r != end();
+
+    // Porównania i wyszukiwania, bez modyfikacji.
+    std::vector<iterator> points;
+    std::vector<rg_iterator> old_values;
+    std::vector<mx_iterator> to_erase;
+    std::unordered_map<V const*, rg_iterator> old_entries;
+    for (iterator it = first; it != last; ++it) {
+        auto known = old_entries.find(&it->value());
+        if (known == old_entries.end())
+            known = old_entries.emplace(&it->value(), rg_find(it->value())).first;
+        points.push_back(it);
+        old_values.push_back(known->second);
+        if (left_check(it) && right_check(it))
+            to_erase.push_back(maxima.find(*it));
+    }
+    size_type k = points.size();
+
+    bool will_be_max_first = (!left_exist || !(v < outer_l->value()))
+            && (k > 1 || !right_exist || !(v < outer_r->value()));
+    bool will_be_max_last = k == 1
+            ? will_be_max_first
+            : !right_exist || !(v < outer_r->value());
+    bool will_be_max_l = left_exist && left_check(outer_l) && !(outer_l->value() < v);
+    bool will_be_max_r = right_exist && right_check(outer_r) && !(outer_r->value() < v);
+    mx_iterator mx_l = left_exist ? maxima.find(*outer_l) : mx_end();
+    mx_iterator mx_r = right_exist ? maxima.find(*outer_r) : mx_end();
+
+    auto [v_new, v_inserted] = intern(v);
+    mx_iterator inserted_l = mx_end(), inserted_r = mx_end();
+    try {
+        std::vector<point_type> plateau;
+        plateau.reserve(k);
+        for (size_type i = 0; i < k; ++i) {
+            if ((i == 0 && !will_be_max_first) || (i == k - 1 && !will_be_max_last))
+                continue;
+            plateau.push_back(point_type{points[i]->arg_ptr, v_new->ptr});
+        }
+
+        if (will_be_max_l && mx_l == mx_end())
+            inserted_l = maxima.insert(*outer_l).first;
+        if (will_be_max_r && mx_r == mx_end())
+            inserted_r = maxima.insert(*outer_r).first;
+
+        // Blok płaskowyżu trafia tuż przed pierwsze maksimum większe od
+        // (v, ostatni argument), które nie leży w przedziale - te z przedziału
+        // zaraz usuniemy.
+        if (!plateau.empty()) {
+            mx_iterator pos = maxima.upper_bound(plateau.back());
+            while (pos != mx_end() && !(pos->arg() < lo) && !(hi < pos->arg()))
+                ++pos;
+            maxima.insert_sorted_before(pos, plateau.begin(), plateau.end());
+        }
+    } catch (...) {
+        if (inserted_r != mx_end())
+            maxima.erase(inserted_r);
+        if (inserted_l != mx_end())
+            maxima.erase(inserted_l);
+        if (v_inserted)
+            range.erase(v_new);
+        throw;
+    }
 
+    // Zatwierdzenie - już tylko operacje noexcept.
+    v_new->users += k;
+    for (size_type i = 0; i < k; ++i) {
+        points[i]->replace_value(v_new->ptr);
+        release(old_values[i]);
+    }
+    for (mx_iterator mx_it : to_erase)
+        maxima.erase(mx_it);
+    if (!will_be_max_l && mx_l != mx_end())
+        maxima.erase(mx_l);
+    if (!will_be_max_r && mx_r != mx_end())
+        maxima.erase(mx_r);
 }
 
 template <typename A, typename V>
-void FunctionMaxima<A, V>::erase(A const& a) {
-    iterator to_erase = find(a);
-    if (to_erase != end()) {
-        bool should_erase_left_mx = false, should_erase_right_mx = false;
-        rg_iterator rg_it = rg_find(to_erase->value());
-        mx_iterator left_mx = mx_end(), right_mx = mx_end();
-        mx_iterator mx_it = maxima.find(*to_erase);
-        try {
-            if (rg_it == rg_end()) // for debug only
-                assert(false);
-            if (to_erase != begin()) {
-                iterator left = std::prev(to_erase);
-                if (is_maximum(left, to_erase))
-                    left_mx = maxima.insert(*left).first;
-                else
-                    should_erase_left_mx = true;
+template <typename Pool>
+void FunctionMaxima<A, V>::apply_parallel(std::vector<std::pair<A, V>> batch, Pool& pool) {
+    using update = std::pair<A, V>;
+    size_type pieces = std::max<size_type>(1, pool.concurrency() * 4);
+    // Kawałki co najmniej po 1024 elementy, żeby zadania nie były zbyt drobne.
+    auto chunk_count = [&](size_type n) {
+        return std::max<size_type>(1, std::min(pieces, n / 1024));
+    };
+    auto run_chunks = [&](size_type n, auto&& f) {
+        size_type c = chunk_count(n);
+        pool.parallel_for(c, [&](size_type j) {
+            f(j, j * n / c, (j + 1) * n / c);
+        });
+    };
+
+    // Sortowanie stabilne zachowuje kolejność powtórzeń - zostaje ostatnie.
+    maxima_detail::parallel_stable_sort(batch, [](update const& x, update const& y) {
+        return x.first < y.first;
+    }, pool, pieces);
+    size_type k = 0;
+    for (size_type i = 0; i < batch.size(); ++i) {
+        if (i + 1 < batch.size() && !(batch[i].first < batch[i + 1].first))
+            continue;
+        if (k != i)
+            batch[k] = std::move(batch[i]);
+        ++k;
+    }
+    batch.erase(batch.begin() + k, batch.end());
+
+    // Pozycje w dziedzinie; pomijamy punkty, których wartość się nie zmienia.
+    std::vector<iterator> pos(k);
+    std::vector<char> found(k), changed(k);
+    run_chunks(k, [&](size_type, size_type first, size_type last) {
+        for (size_type i = first; i < last; ++i) {
+            iterator it = fun.lower_bound(batch[i].first);
+            bool f = it != end() && !(batch[i].first < it->arg());
+            pos[i] = it;
+            found[i] = f;
+            changed[i] = !f || it->value() < batch[i].second || batch[i].second < it->value();
+        }
+    });
+    size_type m = 0;
+    for (size_type i = 0; i < k; ++i) {
+        if (!changed[i])
+            continue;
+        if (m != i) {
+            batch[m] = std::move(batch[i]);
+            pos[m] = pos[i];
+            found[m] = found[i];
+        }
+        ++m;
+    }
+    k = m;
+    if (k == 0)
+        return;
+
+    // Sąsiad punktu po aplikacji paczki: index < k to punkt paczki,
+    // w przeciwnym razie dotychczasowy punkt old (end(), gdy sąsiada brak).
+    struct neighbor {
+        iterator old;
+        size_type index;
+    };
+    iterator const fun_begin = begin(), fun_end = end();
+    auto left_of = [&](size_type i) -> neighbor {
+        if (i > 0 && (found[i - 1] ? std::next(pos[i - 1]) == pos[i] : pos[i - 1] == pos[i]))
+            return {fun_end, i - 1};
+        return {pos[i] == fun_begin ? fun_end : std::prev(pos[i]), k};
+    };
+    auto right_of = [&](size_type i) -> neighbor {
+        iterator r = found[i] ? std::next(pos[i]) : pos[i];
+        if (i + 1 < k && r == pos[i + 1])
+            return {fun_end, i + 1};
+        return {r, k};
+    };
+    // Sąsiedzi dotychczasowego punktu q, którego prawym (lewym) sąsiadem
+    // zostaje i-ty punkt paczki.
+    auto left_of_old = [&](iterator q, size_type i) -> neighbor {
+        iterator p = q == fun_begin ? fun_end : std::prev(q);
+        if (i > 0 && (found[i - 1] ? pos[i - 1] == p : pos[i - 1] == q))
+            return {fun_end, i - 1};
+        return {p, k};
+    };
+    auto right_of_old = [&](iterator q, size_type i) -> neighbor {
+        iterator nx = std::next(q);
+        if (i + 1 < k && pos[i + 1] == nx)
+            return {fun_end, i + 1};
+        return {nx, k};
+    };
+    auto value_of = [&](neighbor n) -> V const* {
+        if (n.index < k)
+            return &batch[n.index].second;
+        return n.old != fun_end ? &n.old->value() : nullptr;
+    };
+    auto peak = [&](V const& v, neighbor l, neighbor r) {
+        V const* lv = value_of(l);
+        V const* rv = value_of(r);
+        return (!lv || !(v < *lv)) && (!rv || !(v < *rv));
+    };
+
+    // Dotychczasowy punkt, który zyskuje (mx == mx_end()) lub traci status
+    // lokalnego maksimum.
+    struct neighbor_change {
+        iterator point;
+        mx_iterator mx;
+    };
+    std::vector<char> will_be_max(k);
+    std::vector<mx_iterator> old_mx(k);
+    std::vector<rg_iterator> old_values(k), new_values(k);
+    std::vector<std::shared_ptr<A>> args(k);
+    std::vector<std::vector<neighbor_change>> changes(chunk_count(k));
+    run_chunks(k, [&](size_type j, size_type first, size_type last) {
+        auto check_old = [&](iterator q, neighbor l, neighbor r) {
+            mx_iterator mx = maxima.find(*q);
+            bool will = peak(q->value(), l, r);
+            if (will != (mx != mx_end()))
+                changes[j].push_back(neighbor_change{q, will ? mx_end() : mx});
+        };
+        for (size_type i = first; i < last; ++i) {
+            neighbor l = left_of(i);
+            neighbor r = right_of(i);
+            will_be_max[i] = peak(batch[i].second, l, r);
+            old_mx[i] = found[i] ? maxima.find(*pos[i]) : mx_end();
+            old_values[i] = found[i] ? rg_find(pos[i]->value()) : rg_end();
+            new_values[i] = rg_find(batch[i].second);
+            args[i] = found[i] ? pos[i]->arg_ptr : std::make_shared<A>(batch[i].first);
+            if (l.index == k && l.old != fun_end)
+                check_old(l.old, left_of_old(l.old, i), neighbor{fun_end, i});
+            // Punkt leżący sam między i a i + 1 sprawdza i + 1 jako swojego
+            // lewego sąsiada - także gdy i + 1 należy do następnego kawałka.
+            if (r.index == k && r.old != fun_end) {
+                neighbor next_left = i + 1 < k ? left_of(i + 1) : neighbor{fun_end, k};
+                if (!(next_left.index == k && next_left.old == r.old))
+                    check_old(r.old, neighbor{fun_end, i}, right_of_old(r.old, i));
             }
-            iterator right = std::next(to_erase);
-            if (right != end()) {
-                if (is_maximum(right, to_erase))
-                    right_mx = maxima.insert(*right).first;
-                else
-                    should_erase_right_mx = true;
+        }
+    });
+
+    // Modyfikacje; w razie wyjątku cofamy je operacjami noexcept.
+    std::vector<rg_iterator> fresh;
+    std::vector<iterator> fun_inserted;
+    std::vector<mx_iterator> mx_inserted;
+    try {
+        for (size_type i = 0; i < k; ++i) {
+            if (new_values[i] != rg_end())
+                continue;
+            auto [entry, is_fresh] = intern(batch[i].second);
+            if (is_fresh)
+                fresh.push_back(entry);
+            new_values[i] = entry;
+        }
+
+        std::vector<iterator> fun_positions;
+        std::vector<point_type> fun_points;
+        for (size_type i = 0; i < k; ++i) {
+            if (!found[i]) {
+                fun_positions.push_back(pos[i]);
+                fun_points.push_back(point_type{args[i], new_values[i]->ptr});
             }
-        } catch (...) {
-            if (left_mx != mx_end()) {
-                maxima.erase(left_mx);
-                if (right_mx != mx_end())
-                    maxima.erase(right_mx);
+        }
+        fun_inserted = fun.insert_before_parallel(fun_positions, fun_points, pool, pieces);
+
+        std::vector<point_type> mx_points;
+        for (size_type i = 0; i < k; ++i) {
+            if (will_be_max[i])
+                mx_points.push_back(point_type{args[i], new_values[i]->ptr});
+        }
+        for (auto const& chunk : changes) {
+            for (neighbor_change const& c : chunk) {
+                if (c.mx == mx_end())
+                    mx_points.push_back(*c.point);
             }
         }
-        if (mx_it != mx_end())
+        // Posortowane punkty wstawiamy przed ich miejsca w dotychczasowych
+        // maksimach; wpisy do usunięcia zostają do zatwierdzenia, a nowe
+        // klucze są od nich różne.
+        maxima_detail::parallel_stable_sort(mx_points, maxima_order(), pool, pieces);
+        std::vector<mx_iterator> mx_positions(mx_points.size());
+        run_chunks(mx_points.size(), [&](size_type, size_type first, size_type last) {
+            for (size_type i = first; i < last; ++i)
+                mx_positions[i] = maxima.lower_bound(mx_points[i]);
+        });
+        mx_inserted = maxima.insert_before_parallel(mx_positions, mx_points, pool, pieces);
+    } catch (...) {
+        for (mx_iterator mx_it : mx_inserted)
             maxima.erase(mx_it);
-        fun.erase(to_erase);
-        if (rg_it->expired())
+        for (iterator it : fun_inserted)
+            fun.erase(it);
+        for (rg_iterator rg_it : fresh)
             range.erase(rg_it);
-        if (should_erase_left_mx)
-            maxima.erase(left_mx);
-        if (should_erase_right_mx)
-            maxima.erase(right_mx);
         throw;
     }
+
+    // Zatwierdzenie - już tylko operacje noexcept.
+    for (rg_iterator rg_it : new_values)
+        ++rg_it->users;
+    for (size_type i = 0; i < k; ++i) {
+        if (found[i]) {
+            pos[i]->replace_value(new_values[i]->ptr);
+            release(old_values[i]);
+        }
+        if (old_mx[i] != mx_end())
+            maxima.erase(old_mx[i]);
+    }
+    for (auto const& chunk : changes) {
+        for (neighbor_change const& c : chunk) {
+            if (c.mx != mx_end())
+                maxima.erase(c.mx);
+        }
+    }
+}
+
+template <typename A, typename V>
+template <typename F>
+void FunctionMaxima<A, V>::transform_values(F f) {
+    // Przy ściśle rosnącej f nowe wartości w kolejności zbioru wartości są
+    // posortowane, więc każdą wstawiamy na koniec nowego zbioru.
+    range_set new_range;
+    std::unordered_map<V const*, std::shared_ptr<V>> new_value;
+    new_value.reserve(range.size());
+    for (range_entry const& e : range) {
+        auto ptr = std::make_shared<V>(f(*e.ptr));
+        assert(new_range.empty() || *std::prev(new_range.end())->ptr < *ptr);
+        new_range.insert(new_range.end(), range_entry{ptr, e.users});
+        new_value.emplace(e.ptr.get(), std::move(ptr));
+    }
+
+    auto moved = [&](point_type const& p) {
+        return point_type(p.arg_ptr, new_value.find(p.value_ptr.get())->second);
+    };
+    std::vector<point_type> points;
+    points.reserve(fun.size());
+    for (point_type const& p : fun)
+        points.push_back(moved(p));
+    function_set new_fun;
+    new_fun.insert_sorted_before(new_fun.end(), points.begin(), points.end());
+    points.clear();
+    for (point_type const& p : maxima)
+        points.push_back(moved(p));
+    maxima_set new_maxima;
+    new_maxima.insert_sorted_before(new_maxima.end(), points.begin(), points.end());
+
+    fun.swap(new_fun);
+    maxima.swap(new_maxima);
+    range.swap(new_range);
 }
-#endif //MAKSIMA_FUNCTION_MAXIMA_H
\ No newline at end of file
+
+template <typename A, typename V>
+template <typename It>
+void FunctionMaxima<A, V>::assign_sorted(It first, It last) {
+    std::vector<std::pair<A, V>> input(first, last);
+    std::size_t n = input.size();
+    // Sortujemy zwarte pary (wartość, indeks) zamiast skakać po wskaźnikach.
+    using keyed = std::pair<V, std::size_t>;
+    auto by_value = [](keyed const& x, keyed const& y) {
+        return x.first < y.first || (!(y.first < x.first) && x.second < y.second);
+    };
+
+    // Równe wartości dostają jeden wspólny wskaźnik.
+    std::vector<keyed> values;
+    values.reserve(n);
+    for (std::size_t i = 0; i < n; ++i)
+        values.emplace_back(input[i].second, i);
+    std::sort(values.begin(), values.end(), by_value);
+    std::vector<std::shared_ptr<V>> value_of(n);
+    range_set new_range;
+    for (std::size_t k = 0; k < n;) {
+        V const& v = values[k].first;
+        auto ptr = std::make_shared<V>(v);
+        std::size_t users = 0;
+        for (; k < n && !(v < values[k].first); ++k, ++users)
+            value_of[values[k].second] = ptr;
+        new_range.insert(new_range.end(), range_entry{std::move(ptr), users});
+    }
+    values.clear();
+
+    std::vector<point_type> points;
+    points.reserve(n);
+    for (std::size_t i = 0; i < n; ++i)
+        points.push_back(point_type(std::make_shared<A>(input[i].first), value_of[i]));
+    function_set new_fun;
+    new_fun.insert_sorted_before(new_fun.end(), points.begin(), points.end());
+
+    // Maksima: malejąco po wartości, a przy równych - rosnąco po indeksie,
+    // czyli po argumencie, jak w maxima_order.
+    for (std::size_t i = 0; i < n; ++i) {
+        V const& v = input[i].second;
+        if ((i == 0 || !(v < input[i - 1].second)) && (i + 1 == n || !(v < input[i + 1].second)))
+            values.emplace_back(v, i);
+    }
+    std::sort(values.begin(), values.end(), [&](keyed const& x, keyed const& y) {
+        return by_value(keyed(y.first, x.second), keyed(x.first, y.second));
+    });
+    std::vector<point_type> peaks;
+    peaks.reserve(values.size());
+    for (keyed const& k : values)
+        peaks.push_back(points[k.second]);
+    maxima_set new_maxima;
+    new_maxima.insert_sorted_before(new_maxima.end(), peaks.begin(), peaks.end());
+
+    fun.swap(new_fun);
+    maxima.swap(new_maxima);
+    range.swap(new_range);
+}
+
+#endif //MAKSIMA_FUNCTION_MAXIMA_H
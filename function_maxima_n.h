@@ -0,0 +1,377 @@
+#ifndef MAKSIMA_FUNCTION_MAXIMA_N_H
+#define MAKSIMA_FUNCTION_MAXIMA_N_H
+
+#include "function_maxima.h"
+
+#include <tuple>
+#include <type_traits>
+
+// Funkcja o kilku wartościach (kanałach) dla każdego argumentu, np. cena,
+// wolumen i spread o wspólnych znacznikach czasu. Dziedzina jest
+// przechowywana i przeszukiwana raz, a każdy kanał ma osobny zbiór lokalnych
+// maksimów zdefiniowanych tak jak w FunctionMaxima.
+template <typename A, typename... Vs>
+class FunctionMaximaN {
+    static_assert(sizeof...(Vs) > 0, "at least one value channel required");
+
+public:
+    static constexpr std::size_t channels = sizeof...(Vs);
+
+    template <std::size_t I>
+    using value_type = std::tuple_element_t<I, std::tuple<Vs...>>;
+
+    // Punkt funkcji: argument i wartości wszystkich kanałów.
+    class point_type {
+    private:
+        std::shared_ptr<A> arg_ptr;
+        mutable std::tuple<std::shared_ptr<Vs>...> value_ptrs;
+        explicit point_type(std::shared_ptr<A> arg,
+                            std::tuple<std::shared_ptr<Vs>...> values)
+            : arg_ptr(std::move(arg)), value_ptrs(std::move(values)) {}
+        friend class FunctionMaximaN;
+    public:
+        point_type(const point_type&) = default;
+        point_type& operator=(const point_type&) = default;
+        // Zwraca argument funkcji.
+        A const& arg() const noexcept {
+            return *arg_ptr;
+        }
+        // Zwraca wartość kanału I w tym punkcie.
+        template <std::size_t I>
+        value_type<I> const& value() const noexcept {
+            return *std::get<I>(value_ptrs);
+        }
+    };
+
+    // Lokalne maksimum kanału I: argument i wartość tego kanału.
+    template <std::size_t I>
+    class mx_point {
+    private:
+        std::shared_ptr<A> arg_ptr;
+        std::shared_ptr<value_type<I>> value_ptr;
+        explicit mx_point(std::shared_ptr<A> arg, std::shared_ptr<value_type<I>> value)
+            : arg_ptr(std::move(arg)), value_ptr(std::move(value)) {}
+        friend class FunctionMaximaN;
+    public:
+        mx_point(const mx_point&) = default;
+        mx_point& operator=(const mx_point&) = default;
+        A const& arg() const noexcept {
+            return *arg_ptr;
+        }
+        value_type<I> const& value() const noexcept {
+            return *value_ptr;
+        }
+    };
+
+private:
+    struct argument_order {
+        using is_transparent = void;
+        bool operator()(const point_type& x, const point_type& y) const {
+            return *x.arg_ptr < *y.arg_ptr;
+        }
+        bool operator()(const point_type& x, const A& y) const {
+            return *x.arg_ptr < y;
+        }
+        bool operator()(const A& x, const point_type& y) const {
+            return x < *y.arg_ptr;
+        }
+    };
+    using function_set = maxima_detail::order_tree<point_type, argument_order>;
+
+    template <std::size_t I>
+    struct maxima_order {
+        using is_transparent = void;
+        bool operator()(const mx_point<I>& x, const mx_point<I>& y) const {
+            return y.value() < x.value() || (!(x.value() < y.value()) && x.arg() < y.arg());
+        }
+    };
+    template <std::size_t I>
+    using maxima_set = maxima_detail::order_tree<mx_point<I>, maxima_order<I>>;
+
+    template <typename Is>
+    struct maxima_sets;
+    template <std::size_t... Is>
+    struct maxima_sets<std::index_sequence<Is...>> {
+        using type = std::tuple<maxima_set<Is>...>;
+    };
+
+public:
+    using iterator = typename function_set::const_iterator;
+    template <std::size_t I>
+    using mx_iterator = typename maxima_set<I>::const_iterator;
+    using size_type = typename function_set::size_type;
+
+    iterator begin() const noexcept {
+        return fun.cbegin();
+    }
+    iterator end() const noexcept {
+        return fun.cend();
+    }
+    iterator find(A const& a) const {
+        return fun.find(a);
+    }
+    size_type size() const noexcept {
+        return fun.size();
+    }
+
+    // Lokalne maksima kanału I, malejąco po wartościach.
+    template <std::size_t I>
+    mx_iterator<I> mx_begin() const noexcept {
+        return std::get<I>(maxima).cbegin();
+    }
+    template <std::size_t I>
+    mx_iterator<I> mx_end() const noexcept {
+        return std::get<I>(maxima).cend();
+    }
+    template <std::size_t I>
+    size_type mx_size() const noexcept {
+        return std::get<I>(maxima).size();
+    }
+
+    FunctionMaximaN() = default;
+    FunctionMaximaN(const FunctionMaximaN&) = default;
+    FunctionMaximaN& operator=(const FunctionMaximaN&) = default;
+
+    // Wartość kanału I w punkcie a; InvalidArg, jeśli a nie należy do
+    // dziedziny. O(log n).
+    template <std::size_t I>
+    value_type<I> const& value_at(A const& a) const {
+        iterator it = find(a);
+        if (it == end())
+            throw InvalidArg();
+        return it->template value<I>();
+    }
+
+    // Ustawia wszystkie kanały w punkcie a, dodając a do dziedziny w razie
+    // potrzeby. Argument jest wyszukiwany raz dla wszystkich kanałów.
+    // O(channels * log n), silna gwarancja.
+    void set_value(A const& a, Vs const&... vs) {
+        set_channels(a, std::index_sequence_for<Vs...>{}, vs...);
+    }
+
+    // Ustawia kanał I w punkcie a, który musi należeć do dziedziny
+    // (inaczej InvalidArg). O(log n), silna gwarancja.
+    template <std::size_t I>
+    void set_channel(A const& a, value_type<I> const& v);
+
+    // Usuwa a z dziedziny (nic się nie dzieje, jeśli go nie ma).
+    // O(channels * log n), silna gwarancja.
+    void erase(A const& a) {
+        erase_channels(a, std::index_sequence_for<Vs...>{});
+    }
+
+private:
+    function_set fun;
+    typename maxima_sets<std::index_sequence_for<Vs...>>::type maxima;
+
+    // Zmiany w zbiorze maksimów jednego kanału, wyznaczone przed
+    // modyfikacją: co wstawić (z możliwością cofnięcia) i co usunąć.
+    template <std::size_t I>
+    struct channel_update {
+        bool skip = false;
+        bool will_be_max = false, will_be_max_l = false, will_be_max_r = false;
+        mx_iterator<I> old_mx, old_mx_l, old_mx_r;
+        mx_iterator<I> inserted, inserted_l, inserted_r;
+    };
+
+    template <std::size_t I>
+    mx_point<I> entry_of(point_type const& p) const {
+        return mx_point<I>{p.arg_ptr, std::get<I>(p.value_ptrs)};
+    }
+
+    template <std::size_t I>
+    bool left_check(iterator it) const {
+        if (it == begin())
+            return true;
+        return !(it->template value<I>() < std::prev(it)->template value<I>());
+    }
+    template <std::size_t I>
+    bool right_check(iterator it) const {
+        iterator right = std::next(it);
+        if (right == end())
+            return true;
+        return !(it->template value<I>() < right->template value<I>());
+    }
+
+    // Plan dla nowej wartości v kanału I w punkcie między left a right
+    // (it == end(), jeśli punkt jest nowy).
+    template <std::size_t I>
+    channel_update<I> plan_set(iterator left, iterator it, iterator right,
+                               value_type<I> const& v) const {
+        maxima_set<I> const& mx = std::get<I>(maxima);
+        channel_update<I> u;
+        u.old_mx = u.old_mx_l = u.old_mx_r = mx.cend();
+        u.inserted = u.inserted_l = u.inserted_r = mx.cend();
+        if (it != end()) {
+            value_type<I> const& old = it->template value<I>();
+            if (!(old < v) && !(v < old)) {
+                u.skip = true;
+                return u;
+            }
+            u.old_mx = mx.find(entry_of<I>(*it));
+        }
+        bool left_exist = left != end();
+        bool right_exist = right != end();
+        u.will_be_max = (!left_exist || !(v < left->template value<I>()))
+                && (!right_exist || !(v < right->template value<I>()));
+        u.will_be_max_l = left_exist && left_check<I>(left)
+                && !(left->template value<I>() < v);
+        u.will_be_max_r = right_exist && right_check<I>(right)
+                && !(right->template value<I>() < v);
+        if (left_exist)
+            u.old_mx_l = mx.find(entry_of<I>(*left));
+        if (right_exist)
+            u.old_mx_r = mx.find(entry_of<I>(*right));
+        return u;
+    }
+
+    // Plan dla usunięcia punktu it; left i right zostaną sąsiadami.
+    template <std::size_t I>
+    channel_update<I> plan_erase(iterator left, iterator it, iterator right) const {
+        maxima_set<I> const& mx = std::get<I>(maxima);
+        channel_update<I> u;
+        u.inserted = u.inserted_l = u.inserted_r = mx.cend();
+        bool left_exist = left != end();
+        bool right_exist = right != end();
+        u.will_be_max_l = left_exist && left_check<I>(left) && (!right_exist
+                || !(left->template value<I>() < right->template value<I>()));
+        u.will_be_max_r = right_exist && right_check<I>(right) && (!left_exist
+                || !(right->template value<I>() < left->template value<I>()));
+        u.old_mx = mx.find(entry_of<I>(*it));
+        u.old_mx_l = left_exist ? mx.find(entry_of<I>(*left)) : mx.cend();
+        u.old_mx_r = right_exist ? mx.find(entry_of<I>(*right)) : mx.cend();
+        return u;
+    }
+
+    // Wstawienia do zbioru maksimów; każde z osobna daje silną gwarancję,
+    // a całość cofa rollback.
+    template <std::size_t I>
+    void apply(channel_update<I>& u, iterator left, iterator right,
+               mx_point<I> const& new_entry) {
+        if (u.skip)
+            return;
+        maxima_set<I>& mx = std::get<I>(maxima);
+        if (u.will_be_max)
+            u.inserted = mx.insert(new_entry).first;
+        if (u.will_be_max_l && u.old_mx_l == mx.cend())
+            u.inserted_l = mx.insert(entry_of<I>(*left)).first;
+        if (u.will_be_max_r && u.old_mx_r == mx.cend())
+            u.inserted_r = mx.insert(entry_of<I>(*right)).first;
+    }
+
+    template <std::size_t I>
+    void rollback(channel_update<I>& u) noexcept {
+        maxima_set<I>& mx = std::get<I>(maxima);
+        if (u.inserted_r != mx.cend())
+            mx.erase(u.inserted_r);
+        if (u.inserted_l != mx.cend())
+            mx.erase(u.inserted_l);
+        if (u.inserted != mx.cend())
+            mx.erase(u.inserted);
+    }
+
+    template <std::size_t I>
+    void commit(channel_update<I>& u) noexcept {
+        if (u.skip)
+            return;
+        maxima_set<I>& mx = std::get<I>(maxima);
+        if (u.old_mx != mx.cend())
+            mx.erase(u.old_mx);
+        if (!u.will_be_max_l && u.old_mx_l != mx.cend())
+            mx.erase(u.old_mx_l);
+        if (!u.will_be_max_r && u.old_mx_r != mx.cend())
+            mx.erase(u.old_mx_r);
+    }
+
+    template <std::size_t... Is>
+    void set_channels(A const& a, std::index_sequence<Is...>, Vs const&... vs);
+
+    template <std::size_t... Is>
+    void erase_channels(A const& a, std::index_sequence<Is...>);
+};
+
+template <typename A, typename... Vs>
+template <std::size_t... Is>
+void FunctionMaximaN<A, Vs...>::set_channels(A const& a, std::index_sequence<Is...>,
+                                             Vs const&... vs) {
+    iterator right = fun.lower_bound(a);
+    bool found = right != end() && !(a < right->arg());
+    iterator it = found ? right : end();
+    if (found)
+        ++right;
+    iterator left = end();
+    if ((found ? it : right) != begin())
+        left = std::prev(found ? it : right);
+
+    std::tuple<channel_update<Is>...> updates{plan_set<Is>(left, it, right, vs)...};
+    if ((std::get<Is>(updates).skip && ...))
+        return;
+
+    std::shared_ptr<A> a_ptr = found ? it->arg_ptr : std::make_shared<A>(a);
+    std::tuple<std::shared_ptr<Vs>...> v_ptrs{
+            std::get<Is>(updates).skip
+            ? std::get<Is>(it->value_ptrs)
+            : std::make_shared<Vs>(vs)...};
+
+    iterator inserted_fun = end();
+    try {
+        if (!found)
+            inserted_fun = fun.insert_before(right, point_type{a_ptr, v_ptrs});
+        (apply<Is>(std::get<Is>(updates), left, right,
+                   mx_point<Is>{a_ptr, std::get<Is>(v_ptrs)}), ...);
+    } catch (...) {
+        (rollback<Is>(std::get<Is>(updates)), ...);
+        if (inserted_fun != end())
+            fun.erase(inserted_fun);
+        throw;
+    }
+
+    if (found)
+        it->value_ptrs = std::move(v_ptrs);
+    (commit<Is>(std::get<Is>(updates)), ...);
+}
+
+template <typename A, typename... Vs>
+template <std::size_t I>
+void FunctionMaximaN<A, Vs...>::set_channel(A const& a, value_type<I> const& v) {
+    iterator it = find(a);
+    if (it == end())
+        throw InvalidArg();
+    iterator left = it == begin() ? end() : std::prev(it);
+    iterator right = std::next(it);
+
+    channel_update<I> u = plan_set<I>(left, it, right, v);
+    if (u.skip)
+        return;
+    auto v_ptr = std::make_shared<value_type<I>>(v);
+    try {
+        apply<I>(u, left, right, mx_point<I>{it->arg_ptr, v_ptr});
+    } catch (...) {
+        rollback<I>(u);
+        throw;
+    }
+    std::get<I>(it->value_ptrs) = std::move(v_ptr);
+    commit<I>(u);
+}
+
+template <typename A, typename... Vs>
+template <std::size_t... Is>
+void FunctionMaximaN<A, Vs...>::erase_channels(A const& a, std::index_sequence<Is...>) {
+    iterator it = find(a);
+    if (it == end())
+        return;
+    iterator left = it == begin() ? end() : std::prev(it);
+    iterator right = std::next(it);
+
+    std::tuple<channel_update<Is>...> updates{plan_erase<Is>(left, it, right)...};
+    try {
+        (apply<Is>(std::get<Is>(updates), left, right, entry_of<Is>(*it)), ...);
+    } catch (...) {
+        (rollback<Is>(std::get<Is>(updates)), ...);
+        throw;
+    }
+    (commit<Is>(std::get<Is>(updates)), ...);
+    fun.erase(it);
+}
+
+#endif //MAKSIMA_FUNCTION_MAXIMA_N_H
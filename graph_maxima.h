@@ -0,0 +1,220 @@
+#ifndef MAKSIMA_GRAPH_MAXIMA_H
+#define MAKSIMA_GRAPH_MAXIMA_H
+
+#include "function_maxima.h"
+
+#include <algorithm>
+#include <vector>
+
+// Lokalne maksima funkcji określonej na wierzchołkach grafu: wierzchołek
+// jest lokalnym maksimum, gdy jego wartość nie jest mniejsza niż wartość
+// żadnego z jego sąsiadów. Uogólnia left_check/right_check z FunctionMaxima
+// na dowolną relację sąsiedztwa, podaną w formacie CSR: sąsiedzi
+// wierzchołka u to targets[offsets[u]] .. targets[offsets[u + 1] - 1].
+// Dla każdego wierzchołka pamiętamy, ilu jego sąsiadów ma większą wartość,
+// dzięki czemu zmiana wartości kosztuje O(d log k) dla d krawędzi
+// incydentnych ze zmienianym wierzchołkiem.
+template <typename V>
+class GraphMaxima {
+public:
+    using size_type = std::size_t;
+
+    // Wierzchołek będący lokalnym maksimum.
+    class point_type {
+    private:
+        size_type n;
+        V v;
+        point_type(size_type n, V const& v) : n(n), v(v) {}
+        friend class GraphMaxima;
+    public:
+        point_type(const point_type&) = default;
+        point_type& operator=(const point_type&) = default;
+        size_type node() const noexcept {
+            return n;
+        }
+        V const& value() const noexcept {
+            return v;
+        }
+    };
+
+private:
+    struct maxima_order {
+        using is_transparent = void;
+        bool operator()(const point_type& x, const point_type& y) const {
+            return y.v < x.v || (!(x.v < y.v) && x.n < y.n);
+        }
+    };
+    using maxima_set = maxima_detail::order_tree<point_type, maxima_order>;
+
+public:
+    using mx_iterator = typename maxima_set::const_iterator;
+
+    // Graf o offsets.size() - 1 wierzchołkach i wartościach values.
+    // Rzuca InvalidArg, gdy opis CSR jest niespójny. O(n + e + k log k).
+    GraphMaxima(std::vector<size_type> offsets, std::vector<size_type> targets,
+                std::vector<V> values);
+
+    GraphMaxima(const GraphMaxima&) = default;
+    GraphMaxima& operator=(const GraphMaxima&) = default;
+
+    size_type size() const noexcept {
+        return values.size();
+    }
+
+    // Wartość w wierzchołku u; InvalidArg dla nieistniejącego wierzchołka.
+    V const& value_at(size_type u) const {
+        check(u);
+        return values[u];
+    }
+
+    // Ustawia wartość w wierzchołku u. O(d log k), silna gwarancja.
+    void set_value(size_type u, V const& v);
+
+    mx_iterator mx_begin() const noexcept {
+        return maxima.cbegin();
+    }
+    mx_iterator mx_end() const noexcept {
+        return maxima.cend();
+    }
+    size_type mx_size() const noexcept {
+        return maxima.size();
+    }
+
+private:
+    std::vector<size_type> out_offsets, out_targets;
+    // Odwrócona relacja: wierzchołki, dla których u jest sąsiadem.
+    std::vector<size_type> in_offsets, in_sources;
+    std::vector<V> values;
+    // Liczba sąsiadów o wartości większej niż wartość wierzchołka.
+    std::vector<size_type> greater;
+    maxima_set maxima;
+
+    void check(size_type u) const {
+        if (u >= values.size())
+            throw InvalidArg();
+    }
+
+    point_type entry(size_type u) const {
+        return point_type(u, values[u]);
+    }
+};
+
+template <typename V>
+GraphMaxima<V>::GraphMaxima(std::vector<size_type> offsets,
+                            std::vector<size_type> targets, std::vector<V> values)
+    : out_offsets(std::move(offsets)), out_targets(std::move(targets)),
+      values(std::move(values)) {
+    size_type n = this->values.size();
+    if (out_offsets.size() != n + 1 || out_offsets[0] != 0
+        || out_offsets[n] != out_targets.size())
+        throw InvalidArg();
+    for (size_type u = 0; u < n; ++u) {
+        if (out_offsets[u + 1] < out_offsets[u])
+            throw InvalidArg();
+    }
+    for (size_type w : out_targets) {
+        if (w >= n)
+            throw InvalidArg();
+    }
+
+    // Transpozycja CSR przez zliczanie.
+    in_offsets.assign(n + 1, 0);
+    for (size_type w : out_targets)
+        ++in_offsets[w + 1];
+    for (size_type u = 0; u < n; ++u)
+        in_offsets[u + 1] += in_offsets[u];
+    in_sources.resize(out_targets.size());
+    std::vector<size_type> fill(in_offsets.begin(), in_offsets.end() - 1);
+    for (size_type u = 0; u < n; ++u) {
+        for (size_type e = out_offsets[u]; e < out_offsets[u + 1]; ++e)
+            in_sources[fill[out_targets[e]]++] = u;
+    }
+
+    greater.assign(n, 0);
+    std::vector<point_type> found;
+    for (size_type u = 0; u < n; ++u) {
+        for (size_type e = out_offsets[u]; e < out_offsets[u + 1]; ++e) {
+            if (this->values[u] < this->values[out_targets[e]])
+                ++greater[u];
+        }
+        if (greater[u] == 0)
+            found.push_back(entry(u));
+    }
+    std::sort(found.begin(), found.end(), maxima_order{});
+    maxima.insert_sorted_before(maxima.cend(), found.begin(), found.end());
+}
+
+template <typename V>
+void GraphMaxima<V>::set_value(size_type u, V const& v) {
+    check(u);
+    V const& old = values[u];
+    if (!(old < v) && !(v < old))
+        return;
+
+    // Nowy licznik dla u i zmiany liczników wierzchołków, których u jest
+    // sąsiadem. Pętle własne (u sąsiadem u) niczego nie zmieniają.
+    size_type greater_u = 0;
+    for (size_type e = out_offsets[u]; e < out_offsets[u + 1]; ++e) {
+        size_type w = out_targets[e];
+        if (w != u && v < values[w])
+            ++greater_u;
+    }
+    struct change {
+        size_type node;
+        bool beaten_before, beaten_after;
+    };
+    std::vector<change> changes;
+    for (size_type e = in_offsets[u]; e < in_offsets[u + 1]; ++e) {
+        size_type w = in_sources[e];
+        if (w == u)
+            continue;
+        bool before = values[w] < old;
+        bool after = values[w] < v;
+        if (before != after)
+            changes.push_back(change{w, before, after});
+    }
+
+    // Wierzchołek może wystąpić wielokrotnie (krawędzie wielokrotne), więc
+    // zmiany grupujemy i liczymy nowe liczniki na boku.
+    std::sort(changes.begin(), changes.end(),
+              [](change const& x, change const& y) { return x.node < y.node; });
+    std::vector<std::pair<size_type, size_type>> counts;
+    for (change const& ch : changes) {
+        if (counts.empty() || counts.back().first != ch.node)
+            counts.emplace_back(ch.node, greater[ch.node]);
+        counts.back().second += ch.beaten_after;
+        counts.back().second -= ch.beaten_before;
+    }
+
+    mx_iterator old_mx = greater[u] == 0 ? maxima.find(entry(u)) : mx_end();
+    std::vector<mx_iterator> to_erase;
+    std::vector<mx_iterator> inserted;
+    inserted.reserve(counts.size() + 1);
+    try {
+        if (greater_u == 0)
+            inserted.push_back(maxima.insert(point_type(u, v)).first);
+        for (auto const& [w, count] : counts) {
+            bool was_max = greater[w] == 0;
+            bool will_be_max = count == 0;
+            if (will_be_max && !was_max)
+                inserted.push_back(maxima.insert(entry(w)).first);
+            else if (!will_be_max && was_max)
+                to_erase.push_back(maxima.find(entry(w)));
+        }
+        values[u] = v;
+    } catch (...) {
+        for (mx_iterator it : inserted)
+            maxima.erase(it);
+        throw;
+    }
+
+    if (old_mx != mx_end())
+        maxima.erase(old_mx);
+    for (mx_iterator it : to_erase)
+        maxima.erase(it);
+    greater[u] = greater_u;
+    for (auto const& [w, count] : counts)
+        greater[w] = count;
+}
+
+#endif //MAKSIMA_GRAPH_MAXIMA_H
@@ -0,0 +1,266 @@
+#ifndef MAKSIMA_GRID_MAXIMA_H
+#define MAKSIMA_GRID_MAXIMA_H
+
+#include "function_maxima.h"
+
+#include <algorithm>
+#include <vector>
+
+// Lokalne maksima funkcji określonej na prostokątnej siatce (np. mapie
+// ciepła). Komórka jest lokalnym maksimum, gdy jej wartość nie jest mniejsza
+// niż wartość żadnego z jej sąsiadów - czterech (krawędziowych) albo ośmiu
+// (także narożnych); komórki brzegowe mają odpowiednio mniej sąsiadów.
+// Wartości są trzymane gęsto, wierszami. Maksima są udostępniane tak jak
+// w FunctionMaxima: malejąco po wartościach, przy równych wartościach
+// w kolejności (wiersz, kolumna).
+template <typename V>
+class GridMaxima {
+public:
+    enum class neighborhood { four, eight };
+
+    using size_type = std::size_t;
+
+    // Komórka siatki będąca lokalnym maksimum.
+    class point_type {
+    private:
+        size_type r, c;
+        V v;
+        point_type(size_type r, size_type c, V const& v) : r(r), c(c), v(v) {}
+        friend class GridMaxima;
+    public:
+        point_type(const point_type&) = default;
+        point_type& operator=(const point_type&) = default;
+        size_type row() const noexcept {
+            return r;
+        }
+        size_type col() const noexcept {
+            return c;
+        }
+        V const& value() const noexcept {
+            return v;
+        }
+    };
+
+private:
+    struct maxima_order {
+        using is_transparent = void;
+        bool operator()(const point_type& x, const point_type& y) const {
+            if (y.v < x.v)
+                return true;
+            if (x.v < y.v)
+                return false;
+            return x.r < y.r || (x.r == y.r && x.c < y.c);
+        }
+    };
+    using maxima_set = maxima_detail::order_tree<point_type, maxima_order>;
+
+public:
+    using mx_iterator = typename maxima_set::const_iterator;
+
+    // Siatka rows x cols wypełniona wartością fill. Wszystkie komórki są
+    // wtedy lokalnymi maksimami. Wymiar 0 daje pustą siatkę bez maksimów.
+    GridMaxima(size_type rows, size_type cols, V const& fill,
+               neighborhood n = neighborhood::four)
+        : rows_(rows), cols_(cols), kind(n), cells(rows * cols, fill) {
+        rebuild_maxima();
+    }
+
+    GridMaxima(const GridMaxima&) = default;
+    GridMaxima& operator=(const GridMaxima&) = default;
+
+    size_type rows() const noexcept {
+        return rows_;
+    }
+    size_type cols() const noexcept {
+        return cols_;
+    }
+
+    // Wartość w komórce (r, c); InvalidArg poza siatką. O(1).
+    V const& value_at(size_type r, size_type c) const {
+        check(r, c);
+        return cells[r * cols_ + c];
+    }
+
+    // Ustawia wartość komórki (r, c), sprawdzając ponownie jedynie ją i jej
+    // sąsiadów. O(d^2 + d log k) dla d sąsiadów; silna gwarancja.
+    void set_value(size_type r, size_type c, V const& v);
+
+    // Zastępuje całą zawartość siatki wartościami values (wierszami)
+    // i wyznacza maksima od nowa jednym przebiegiem porównującym całe
+    // wiersze - pętle bez rozgałęzień, które kompilator wektoryzuje dla
+    // arytmetycznych V. O(n + k log k); silna gwarancja.
+    void load(std::vector<V> values);
+
+    mx_iterator mx_begin() const noexcept {
+        return maxima.cbegin();
+    }
+    mx_iterator mx_end() const noexcept {
+        return maxima.cend();
+    }
+    size_type mx_size() const noexcept {
+        return maxima.size();
+    }
+
+private:
+    size_type rows_, cols_;
+    neighborhood kind;
+    std::vector<V> cells;
+    maxima_set maxima;
+
+    void check(size_type r, size_type c) const {
+        if (r >= rows_ || c >= cols_)
+            throw InvalidArg();
+    }
+
+    // Woła f(nr, nc) dla każdego sąsiada komórki (r, c) leżącego na siatce.
+    template <typename F>
+    void for_each_neighbor(size_type r, size_type c, F&& f) const {
+        static constexpr int dr[] = {-1, 1, 0, 0, -1, -1, 1, 1};
+        static constexpr int dc[] = {0, 0, -1, 1, -1, 1, -1, 1};
+        int count = kind == neighborhood::four ? 4 : 8;
+        for (int i = 0; i < count; ++i) {
+            if ((dr[i] < 0 && r == 0) || (dr[i] > 0 && r + 1 == rows_)
+                || (dc[i] < 0 && c == 0) || (dc[i] > 0 && c + 1 == cols_))
+                continue;
+            f(r + dr[i], c + dc[i]);
+        }
+    }
+
+    point_type entry(size_type r, size_type c) const {
+        return point_type(r, c, cells[r * cols_ + c]);
+    }
+
+    static std::vector<point_type> detect(size_type rows, size_type cols,
+                                          neighborhood kind,
+                                          std::vector<V> const& values);
+
+    void rebuild_maxima() {
+        std::vector<point_type> found = detect(rows_, cols_, kind, cells);
+        maxima_set fresh;
+        fresh.insert_sorted_before(fresh.cend(), found.begin(), found.end());
+        maxima.swap(fresh);
+    }
+};
+
+template <typename V>
+std::vector<typename GridMaxima<V>::point_type>
+GridMaxima<V>::detect(size_type rows, size_type cols, neighborhood kind,
+                      std::vector<V> const& values) {
+    std::vector<point_type> found;
+    // Pusta siatka nie ma maksimów; dla cols == 0 granica cols - 1 poniżej
+    // przekręciłaby się.
+    if (rows == 0 || cols == 0)
+        return found;
+    std::vector<unsigned char> flag(cols);
+    bool diagonal = kind == neighborhood::eight;
+    // Porównanie z sąsiednim wierszem nb przesuniętym o shift kolumn
+    // (-1, 0, 1); kolumny bez takiego sąsiada pozostają bez zmian.
+    auto against = [&](V const* cur, V const* nb, int shift) {
+        size_type from = shift < 0 ? 1 : 0;
+        size_type to = shift > 0 ? cols - 1 : cols;
+        for (size_type c = from; c < to; ++c)
+            flag[c] &= !(cur[c] < nb[c + shift]);
+    };
+    for (size_type r = 0; r < rows; ++r) {
+        V const* cur = values.data() + r * cols;
+        std::fill(flag.begin(), flag.end(), 1);
+        against(cur, cur, -1);
+        against(cur, cur, 1);
+        if (r > 0) {
+            V const* up = cur - cols;
+            against(cur, up, 0);
+            if (diagonal) {
+                against(cur, up, -1);
+                against(cur, up, 1);
+            }
+        }
+        if (r + 1 < rows) {
+            V const* down = cur + cols;
+            against(cur, down, 0);
+            if (diagonal) {
+                against(cur, down, -1);
+                against(cur, down, 1);
+            }
+        }
+        for (size_type c = 0; c < cols; ++c) {
+            if (flag[c])
+                found.push_back(point_type(r, c, cur[c]));
+        }
+    }
+    std::sort(found.begin(), found.end(), maxima_order{});
+    return found;
+}
+
+template <typename V>
+void GridMaxima<V>::load(std::vector<V> values) {
+    if (values.size() != rows_ * cols_)
+        throw InvalidArg();
+    std::vector<point_type> found = detect(rows_, cols_, kind, values);
+    maxima_set fresh;
+    fresh.insert_sorted_before(fresh.cend(), found.begin(), found.end());
+    cells.swap(values);
+    maxima.swap(fresh);
+}
+
+template <typename V>
+void GridMaxima<V>::set_value(size_type r, size_type c, V const& v) {
+    check(r, c);
+    size_type idx = r * cols_ + c;
+    if (!(cells[idx] < v) && !(v < cells[idx]))
+        return;
+
+    // Wartość komórki po zmianie.
+    auto value_after = [&](size_type nr, size_type nc) -> V const& {
+        return nr == r && nc == c ? v : cells[nr * cols_ + nc];
+    };
+    auto will_be_max = [&](size_type qr, size_type qc) {
+        bool result = true;
+        V const& qv = value_after(qr, qc);
+        for_each_neighbor(qr, qc, [&](size_type nr, size_type nc) {
+            if (result && qv < value_after(nr, nc))
+                result = false;
+        });
+        return result;
+    };
+
+    // Komórka i jej sąsiedzi - tylko ich status może się zmienić.
+    struct candidate {
+        size_type r, c;
+        bool will;
+        mx_iterator old_mx;
+        mx_iterator inserted;
+    };
+    candidate todo[9];
+    size_type count = 0;
+    todo[count++] = candidate{r, c, will_be_max(r, c), maxima.find(entry(r, c)), mx_end()};
+    for_each_neighbor(r, c, [&](size_type nr, size_type nc) {
+        todo[count++] = candidate{nr, nc, will_be_max(nr, nc),
+                                  maxima.find(entry(nr, nc)), mx_end()};
+    });
+
+    try {
+        // Komórka (r, c) zmienia wartość, więc jej wpis zawsze jest nowy.
+        if (todo[0].will)
+            todo[0].inserted = maxima.insert(point_type(r, c, v)).first;
+        for (size_type i = 1; i < count; ++i) {
+            if (todo[i].will && todo[i].old_mx == mx_end())
+                todo[i].inserted = maxima.insert(entry(todo[i].r, todo[i].c)).first;
+        }
+        cells[idx] = v;
+    } catch (...) {
+        for (size_type i = 0; i < count; ++i) {
+            if (todo[i].inserted != mx_end())
+                maxima.erase(todo[i].inserted);
+        }
+        throw;
+    }
+
+    if (todo[0].old_mx != mx_end())
+        maxima.erase(todo[0].old_mx);
+    for (size_type i = 1; i < count; ++i) {
+        if (!todo[i].will && todo[i].old_mx != mx_end())
+            maxima.erase(todo[i].old_mx);
+    }
+}
+
+#endif //MAKSIMA_GRID_MAXIMA_H
@@ -0,0 +1,496 @@
+#ifndef MAKSIMA_INGEST_PIPELINE_H
+#define MAKSIMA_INGEST_PIPELINE_H
+
+// Asynchroniczne wczytywanie aktualizacji do FunctionMaxima na korutynach
+// C++20: parsowanie -> paczkowanie -> set_value -> publikacja zmian maksimów.
+// Etapy są połączone kolejkami o ograniczonej pojemności, a każdy działa na
+// własnym wątku (executor), więc parsowanie kolejnych danych odbywa się
+// równolegle z aplikowaniem poprzednich paczek. Korutyna zawieszona na
+// pełnej (pustej) kolejce jest wznawiana na swoim executorze przez drugą
+// stronę kolejki.
+
+#include "function_maxima.h"
+
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <condition_variable>
+#include <coroutine>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace ingest {
+
+// Jeden wątek wykonujący wznowienia przekazanych mu korutyn.
+class executor {
+public:
+    executor() : worker([this] { run(); }) {}
+
+    executor(executor const&) = delete;
+    executor& operator=(executor const&) = delete;
+
+    ~executor() {
+        {
+            std::lock_guard<std::mutex> lock(m);
+            stopping = true;
+        }
+        cv.notify_one();
+        worker.join();
+    }
+
+    void post(std::coroutine_handle<> h) {
+        {
+            std::lock_guard<std::mutex> lock(m);
+            ready.push_back(h);
+        }
+        cv.notify_one();
+    }
+
+    // Executor, na którym działa bieżący wątek (nullptr poza executorami).
+    static executor* current() noexcept {
+        return running_on;
+    }
+
+private:
+    std::mutex m;
+    std::condition_variable cv;
+    std::deque<std::coroutine_handle<>> ready;
+    bool stopping = false;
+    std::thread worker;
+    static inline thread_local executor* running_on = nullptr;
+
+    void run() {
+        running_on = this;
+        for (;;) {
+            std::coroutine_handle<> h;
+            {
+                std::unique_lock<std::mutex> lock(m);
+                cv.wait(lock, [this] { return stopping || !ready.empty(); });
+                if (ready.empty())
+                    return;
+                h = ready.front();
+                ready.pop_front();
+            }
+            h.resume();
+        }
+    }
+};
+
+// Korutyna etapu potoku. Startuje dopiero po start(ex); wait() czeka na jej
+// zakończenie i przekazuje ewentualny wyjątek. Korutynę, której nie
+// uruchomiono (np. gdy utworzenie kolejnego etapu zgłosiło wyjątek),
+// destruktor niszczy od razu - nigdy się nie zakończy, więc nie ma na co
+// czekać.
+class task {
+public:
+    // Stan zakończenia trzymany poza ramką korutyny, żeby sygnalizacja
+    // końca nie sięgała do ramki, którą czekający może już zniszczyć.
+    struct completion {
+        std::atomic<bool> done{false};
+        std::exception_ptr error;
+    };
+
+    struct promise_type {
+        std::shared_ptr<completion> state = std::make_shared<completion>();
+
+        task get_return_object() {
+            return task(std::coroutine_handle<promise_type>::from_promise(*this));
+        }
+        std::suspend_always initial_suspend() noexcept {
+            return {};
+        }
+        auto final_suspend() noexcept {
+            struct finish {
+                bool await_ready() noexcept {
+                    return false;
+                }
+                void await_suspend(std::coroutine_handle<promise_type> h) noexcept {
+                    std::shared_ptr<completion> state = h.promise().state;
+                    state->done = true;
+                    state->done.notify_all();
+                }
+                void await_resume() noexcept {}
+            };
+            return finish{};
+        }
+        void return_void() noexcept {}
+        void unhandled_exception() noexcept {
+            state->error = std::current_exception();
+        }
+    };
+
+    task(task&& other) noexcept
+        : h(std::exchange(other.h, nullptr)), state(std::move(other.state)),
+          started(std::exchange(other.started, false)) {}
+    task(task const&) = delete;
+    task& operator=(task const&) = delete;
+
+    ~task() {
+        if (h) {
+            if (started)
+                wait_done();
+            h.destroy();
+        }
+    }
+
+    void start(executor& ex) {
+        ex.post(h);
+        started = true;
+    }
+
+    void wait() {
+        wait_done();
+        if (state->error)
+            std::rethrow_exception(state->error);
+    }
+
+private:
+    std::coroutine_handle<promise_type> h;
+    std::shared_ptr<completion> state;
+    bool started = false;
+
+    explicit task(std::coroutine_handle<promise_type> h) noexcept
+        : h(h), state(h.promise().state) {}
+
+    void wait_done() noexcept {
+        state->done.wait(false);
+    }
+};
+
+// Kolejka o ograniczonej pojemności między dwoma etapami. push i pop są
+// operacjami co_await. pop zwraca std::nullopt, gdy kolejka jest zamknięta
+// i pusta; push zwraca false, gdy kolejka została zamknięta (np. przez
+// odbiorcę, który zakończył się błędem) i wartość odrzucono.
+template <typename T>
+class bounded_channel {
+    struct waiter {
+        std::coroutine_handle<> h;
+        executor* ex;
+        T* pushed;                  // dla czekającego push
+        bool* accepted;
+        std::optional<T>* popped;   // dla czekającego pop
+    };
+
+public:
+    explicit bounded_channel(std::size_t capacity) : capacity(capacity ? capacity : 1) {}
+
+    auto push(T value) {
+        struct awaiter {
+            bounded_channel& ch;
+            T value;
+            bool accepted = true;
+            bool await_ready() noexcept {
+                return false;
+            }
+            bool await_suspend(std::coroutine_handle<> h) {
+                std::unique_lock<std::mutex> lock(ch.m);
+                if (ch.closed) {
+                    accepted = false;
+                    return false;
+                }
+                if (!ch.poppers.empty()) {
+                    waiter w = ch.poppers.front();
+                    ch.poppers.pop_front();
+                    *w.popped = std::move(value);
+                    lock.unlock();
+                    w.ex->post(w.h);
+                    return false;
+                }
+                if (ch.items.size() < ch.capacity) {
+                    ch.items.push_back(std::move(value));
+                    return false;
+                }
+                ch.pushers.push_back(waiter{h, executor::current(), &value, &accepted, nullptr});
+                return true;
+            }
+            bool await_resume() noexcept {
+                return accepted;
+            }
+        };
+        return awaiter{*this, std::move(value)};
+    }
+
+    auto pop() {
+        struct awaiter {
+            bounded_channel& ch;
+            std::optional<T> result;
+            bool await_ready() noexcept {
+                return false;
+            }
+            bool await_suspend(std::coroutine_handle<> h) {
+                std::unique_lock<std::mutex> lock(ch.m);
+                if (!ch.items.empty()) {
+                    result = std::move(ch.items.front());
+                    ch.items.pop_front();
+                    if (!ch.pushers.empty()) {
+                        waiter w = ch.pushers.front();
+                        ch.pushers.pop_front();
+                        ch.items.push_back(std::move(*w.pushed));
+                        lock.unlock();
+                        w.ex->post(w.h);
+                    }
+                    return false;
+                }
+                if (ch.closed)
+                    return false;
+                ch.poppers.push_back(waiter{h, executor::current(), nullptr, nullptr, &result});
+                return true;
+            }
+            std::optional<T> await_resume() {
+                return std::move(result);
+            }
+        };
+        return awaiter{*this, std::nullopt};
+    }
+
+    // Kończy strumień: czekający odbiorcy dostają std::nullopt, a czekający
+    // nadawcy - odmowę.
+    void close() {
+        std::deque<waiter> woken;
+        {
+            std::lock_guard<std::mutex> lock(m);
+            closed = true;
+            woken.swap(poppers);
+            for (waiter& w : pushers) {
+                *w.accepted = false;
+                woken.push_back(w);
+            }
+            pushers.clear();
+        }
+        for (waiter& w : woken)
+            w.ex->post(w.h);
+    }
+
+private:
+    std::mutex m;
+    std::deque<T> items;
+    std::deque<waiter> pushers, poppers;
+    std::size_t capacity;
+    bool closed = false;
+};
+
+template <typename A, typename V>
+using update = std::pair<A, V>;
+
+// Zmiana zbioru lokalnych maksimów: punkt (arg, value) stał się maksimum
+// (raised) albo przestał nim być.
+template <typename A, typename V>
+struct maxima_delta {
+    A arg;
+    V value;
+    bool raised;
+};
+
+// Parsuje wiersze "arg,value" (albo "arg<TAB>value"; liczby całkowite lub
+// zmiennoprzecinkowe) i wysyła je kawałkami po chunk_size aktualizacji.
+// Wiersze, których nie da się sparsować (np. nagłówek), są pomijane.
+template <typename A, typename V>
+task parse_stage(std::string_view text, std::size_t chunk_size,
+                 bounded_channel<std::vector<update<A, V>>>& out) {
+    try {
+        std::vector<update<A, V>> chunk;
+        chunk.reserve(chunk_size);
+        char const* p = text.data();
+        char const* end = p + text.size();
+        while (p < end) {
+            char const* line_end = static_cast<char const*>(
+                    std::memchr(p, '\n', static_cast<std::size_t>(end - p)));
+            if (line_end == nullptr)
+                line_end = end;
+            A a{};
+            V v{};
+            auto [after_arg, arg_error] = std::from_chars(p, line_end, a);
+            if (arg_error == std::errc() && after_arg < line_end
+                && (*after_arg == ',' || *after_arg == '\t')) {
+                auto [after_value, value_error] = std::from_chars(after_arg + 1, line_end, v);
+                if (value_error == std::errc())
+                    chunk.emplace_back(a, v);
+            }
+            p = line_end + 1;
+            if (chunk.size() == chunk_size) {
+                if (!co_await out.push(std::move(chunk)))
+                    co_return;
+                chunk = {};
+                chunk.reserve(chunk_size);
+            }
+        }
+        if (!chunk.empty())
+            co_await out.push(std::move(chunk));
+    } catch (...) {
+        out.close();
+        throw;
+    }
+    out.close();
+}
+
+// Skleja kawałki w paczki po co najmniej batch_size aktualizacji.
+template <typename A, typename V>
+task batch_stage(std::size_t batch_size,
+                 bounded_channel<std::vector<update<A, V>>>& in,
+                 bounded_channel<std::vector<update<A, V>>>& out) {
+    try {
+        std::vector<update<A, V>> batch;
+        while (auto chunk = co_await in.pop()) {
+            if (batch.empty())
+                batch = std::move(*chunk);
+            else
+                batch.insert(batch.end(), chunk->begin(), chunk->end());
+            if (batch.size() >= batch_size) {
+                if (!co_await out.push(std::move(batch))) {
+                    in.close();
+                    co_return;
+                }
+                batch = {};
+            }
+        }
+        if (!batch.empty())
+            co_await out.push(std::move(batch));
+    } catch (...) {
+        in.close();
+        out.close();
+        throw;
+    }
+    out.close();
+}
+
+namespace detail {
+
+// Czy punkt it jest lokalnym maksimum funkcji f (wprost z definicji).
+template <typename A, typename V>
+bool is_maximum(FunctionMaxima<A, V> const& f,
+                typename FunctionMaxima<A, V>::iterator it) {
+    if (it != f.begin() && it->value() < std::prev(it)->value())
+        return false;
+    auto next = std::next(it);
+    return next == f.end() || !(it->value() < next->value());
+}
+
+// Stan maksimów w otoczeniu argumentu a: lewy sąsiad (największy argument
+// mniejszy od a), a, o ile należy do dziedziny, i prawy sąsiad (najmniejszy
+// argument większy od a). Tylko te punkty mogą zmienić status po
+// set_value(a, v), a sąsiedzi wyznaczeni względem a są ci sami przed i po
+// dodaniu a - dzięki temu oba zrzuty opisują te same punkty.
+template <typename A, typename V>
+void snapshot(FunctionMaxima<A, V> const& f, A const& a,
+              std::vector<maxima_delta<A, V>>& out) {
+    out.clear();
+    auto record = [&](typename FunctionMaxima<A, V>::iterator it) {
+        if (is_maximum(f, it))
+            out.push_back(maxima_delta<A, V>{it->arg(), it->value(), true});
+    };
+    auto it = f.nth(f.rank(a));  // pierwszy argument nie mniejszy od a
+    if (it != f.begin())
+        record(std::prev(it));
+    if (it != f.end() && !(a < it->arg())) {
+        record(it);
+        ++it;
+    }
+    if (it != f.end())
+        record(it);
+}
+
+} // namespace detail
+
+// Aplikuje paczki do f i wysyła listę zmian maksimów wywołanych każdą
+// paczką. Zmiany wyznaczamy porównując maksima w otoczeniu każdego
+// aktualizowanego argumentu przed i po set_value.
+template <typename A, typename V>
+task apply_stage(FunctionMaxima<A, V>& f,
+                 bounded_channel<std::vector<update<A, V>>>& in,
+                 bounded_channel<std::vector<maxima_delta<A, V>>>& out) {
+    auto same = [](maxima_delta<A, V> const& x, maxima_delta<A, V> const& y) {
+        return !(x.arg < y.arg) && !(y.arg < x.arg)
+               && !(x.value < y.value) && !(y.value < x.value);
+    };
+    try {
+        std::vector<maxima_delta<A, V>> before, after;
+        while (auto batch = co_await in.pop()) {
+            std::vector<maxima_delta<A, V>> deltas;
+            for (auto const& [a, v] : *batch) {
+                detail::snapshot(f, a, before);
+                f.set_value(a, v);
+                detail::snapshot(f, a, after);
+                for (auto const& d : before) {
+                    if (std::none_of(after.begin(), after.end(),
+                                     [&](auto const& x) { return same(x, d); }))
+                        deltas.push_back(maxima_delta<A, V>{d.arg, d.value, false});
+                }
+                for (auto const& d : after) {
+                    if (std::none_of(before.begin(), before.end(),
+                                     [&](auto const& x) { return same(x, d); }))
+                        deltas.push_back(d);
+                }
+            }
+            if (!co_await out.push(std::move(deltas))) {
+                in.close();
+                co_return;
+            }
+        }
+    } catch (...) {
+        in.close();
+        out.close();
+        throw;
+    }
+    out.close();
+}
+
+// Przekazuje każdą zmianę maksimów do sink(delta).
+template <typename A, typename V, typename Sink>
+task publish_stage(bounded_channel<std::vector<maxima_delta<A, V>>>& in, Sink sink) {
+    try {
+        while (auto deltas = co_await in.pop()) {
+            for (auto const& d : *deltas)
+                sink(d);
+        }
+    } catch (...) {
+        in.close();
+        throw;
+    }
+}
+
+// Cały potok dla tekstu text: parsowanie, paczkowanie, aplikowanie do f
+// i publikacja, każdy etap na osobnym wątku. Kolejki mieszczą po depth
+// elementów. Wraca po przetworzeniu wszystkich danych; wyjątek z dowolnego
+// etapu jest przekazywany dalej (f mogło już przyjąć część paczek).
+template <typename A, typename V, typename Sink>
+void run_pipeline(std::string_view text, FunctionMaxima<A, V>& f, Sink sink,
+                  std::size_t chunk_size = 4096, std::size_t batch_size = 65536,
+                  std::size_t depth = 4) {
+    bounded_channel<std::vector<update<A, V>>> parsed(depth), batches(depth);
+    bounded_channel<std::vector<maxima_delta<A, V>>> deltas(depth);
+
+    executor parse_ex, batch_ex, apply_ex, publish_ex;
+    task parser = parse_stage<A, V>(text, chunk_size, parsed);
+    task batcher = batch_stage<A, V>(batch_size, parsed, batches);
+    task applier = apply_stage<A, V>(f, batches, deltas);
+    task publisher = publish_stage<A, V>(deltas, std::move(sink));
+    try {
+        publisher.start(publish_ex);
+        applier.start(apply_ex);
+        batcher.start(batch_ex);
+        parser.start(parse_ex);
+    } catch (...) {
+        // Zamknięte kolejki kończą etapy, które już wystartowały, więc
+        // destruktory zadań nie będą czekać w nieskończoność.
+        parsed.close();
+        batches.close();
+        deltas.close();
+        throw;
+    }
+    parser.wait();
+    batcher.wait();
+    applier.wait();
+    publisher.wait();
+}
+
+} // namespace ingest
+
+#endif //MAKSIMA_INGEST_PIPELINE_H
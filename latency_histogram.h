@@ -0,0 +1,235 @@
+#ifndef MAKSIMA_LATENCY_HISTOGRAM_H
+#define MAKSIMA_LATENCY_HISTOGRAM_H
+
+// Histogramy czasów operacji FunctionMaxima, włączane przy kompilacji
+// makrem MAKSIMA_LATENCY_HISTOGRAMS (bez niego FunctionMaxima nie dołącza
+// tego pliku i nie mierzy niczego). Mierzymy osobno set_value, które dodaje
+// argument, set_value dla istniejącego argumentu, erase i find (także
+// wywołane przez value_at) - razem z wycofaniem zmian, gdy operacja zgłosi
+// wyjątek, bo to właśnie ono i przebudowy drzew tworzą ogon rozkładu.
+//
+// Kubełki są jak w HdrHistogram: wartości poniżej 2^sub_bits mają własne
+// kubełki, a każdy przedział [2^e, 2^(e+1)) jest dzielony na 2^sub_bits
+// równych kubełków, więc błąd względny odczytanego percentyla nie
+// przekracza 2^-sub_bits (ok. 6%). Liczniki są atomowe (relaxed), bo find
+// jest const i może być wołane współbieżnie.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <iomanip>
+#include <memory>
+#include <ostream>
+
+namespace maxima_latency {
+
+enum class operation { set_new, set_existing, erase, find };
+
+inline constexpr std::size_t operation_count = 4;
+
+inline char const* name(operation op) noexcept {
+    switch (op) {
+        case operation::set_new:
+            return "set_value (new)";
+        case operation::set_existing:
+            return "set_value (existing)";
+        case operation::erase:
+            return "erase";
+        case operation::find:
+            return "find";
+    }
+    return "?";
+}
+
+// Histogram czasów w nanosekundach.
+class histogram {
+public:
+    static constexpr int sub_bits = 4;
+    // Dłuższe czasy (ponad minutę) trafiają do ostatniego kubełka.
+    static constexpr int max_bits = 36;
+    static constexpr std::size_t bucket_count = (std::size_t{max_bits - sub_bits} + 1) << sub_bits;
+
+    histogram() = default;
+    histogram(histogram const&) = delete;
+    histogram& operator=(histogram const&) = delete;
+
+    void record(std::uint64_t ns) noexcept {
+        buckets[bucket(ns)].fetch_add(1, std::memory_order_relaxed);
+        total.fetch_add(1, std::memory_order_relaxed);
+        sum.fetch_add(ns, std::memory_order_relaxed);
+        std::uint64_t m = largest.load(std::memory_order_relaxed);
+        while (m < ns && !largest.compare_exchange_weak(m, ns, std::memory_order_relaxed)) {}
+    }
+
+    std::uint64_t count() const noexcept {
+        return total.load(std::memory_order_relaxed);
+    }
+
+    std::uint64_t max() const noexcept {
+        return largest.load(std::memory_order_relaxed);
+    }
+
+    double mean() const noexcept {
+        std::uint64_t n = count();
+        return n == 0 ? 0 : static_cast<double>(sum.load(std::memory_order_relaxed)) / static_cast<double>(n);
+    }
+
+    // Najmniejszy czas t (z dokładnością do kubełka), taki że co najmniej
+    // p procent pomiarów nie przekracza t; 0 dla pustego histogramu.
+    std::uint64_t percentile(double p) const noexcept {
+        std::uint64_t n = count();
+        if (n == 0)
+            return 0;
+        double wanted = p / 100 * static_cast<double>(n);
+        std::uint64_t target = wanted < 1 ? 1 : static_cast<std::uint64_t>(wanted);
+        if (static_cast<double>(target) < wanted)
+            ++target;
+        std::uint64_t seen = 0;
+        for (std::size_t i = 0; i < bucket_count; ++i) {
+            seen += buckets[i].load(std::memory_order_relaxed);
+            if (seen >= target)
+                return std::min(highest(i), max());
+        }
+        return max();
+    }
+
+    void reset() noexcept {
+        for (auto& b : buckets)
+            b.store(0, std::memory_order_relaxed);
+        total.store(0, std::memory_order_relaxed);
+        sum.store(0, std::memory_order_relaxed);
+        largest.store(0, std::memory_order_relaxed);
+    }
+
+    // Rozkład w formacie HdrHistogram: dla każdego niepustego kubełka górna
+    // granica w ns, liczba pomiarów i odsetek pomiarów nie większych.
+    void dump(std::ostream& out) const {
+        std::uint64_t n = count();
+        std::uint64_t seen = 0;
+        out << std::setw(14) << "ns" << std::setw(14) << "count" << std::setw(12) << "percentile\n";
+        for (std::size_t i = 0; i < bucket_count; ++i) {
+            std::uint64_t c = buckets[i].load(std::memory_order_relaxed);
+            if (c == 0)
+                continue;
+            seen += c;
+            out << std::setw(14) << std::min(highest(i), max()) << std::setw(14) << c
+                << std::setw(11) << std::fixed << std::setprecision(5)
+                << 100.0 * static_cast<double>(seen) / static_cast<double>(n) << '\n';
+        }
+        out << std::defaultfloat;
+    }
+
+private:
+    std::atomic<std::uint64_t> buckets[bucket_count] = {};
+    std::atomic<std::uint64_t> total{0};
+    std::atomic<std::uint64_t> sum{0};
+    std::atomic<std::uint64_t> largest{0};
+
+    static std::size_t bucket(std::uint64_t ns) noexcept {
+        constexpr std::uint64_t limit = (std::uint64_t{1} << max_bits) - 1;
+        if (ns > limit)
+            ns = limit;
+        if (ns < (std::uint64_t{1} << sub_bits))
+            return static_cast<std::size_t>(ns);
+        int e = 63 - __builtin_clzll(ns);
+        std::size_t mantissa = static_cast<std::size_t>(ns >> (e - sub_bits)) & ((std::size_t{1} << sub_bits) - 1);
+        return (static_cast<std::size_t>(e - sub_bits + 1) << sub_bits) + mantissa;
+    }
+
+    // Największy czas należący do kubełka i.
+    static std::uint64_t highest(std::size_t i) noexcept {
+        if (i < (std::size_t{1} << sub_bits))
+            return i;
+        int shift = static_cast<int>(i >> sub_bits) - 1;
+        std::uint64_t mantissa = (i & ((std::size_t{1} << sub_bits) - 1)) | (std::uint64_t{1} << sub_bits);
+        return ((mantissa + 1) << shift) - 1;
+    }
+};
+
+// Histogramy wszystkich mierzonych operacji jednej funkcji.
+class histograms {
+public:
+    histogram const& operator[](operation op) const noexcept {
+        return per_operation[static_cast<std::size_t>(op)];
+    }
+
+    histogram& operator[](operation op) noexcept {
+        return per_operation[static_cast<std::size_t>(op)];
+    }
+
+    void reset() noexcept {
+        for (auto& h : per_operation)
+            h.reset();
+    }
+
+    // Tabela: liczba pomiarów, średnia, wybrane percentyle i maksimum w ns.
+    void dump(std::ostream& out) const {
+        out << std::left << std::setw(22) << "operation" << std::right;
+        for (char const* column : {"count", "mean", "p50", "p90", "p99", "p99.9", "p99.99", "max"})
+            out << std::setw(10) << column;
+        out << '\n';
+        for (std::size_t i = 0; i < operation_count; ++i) {
+            histogram const& h = per_operation[i];
+            out << std::left << std::setw(22) << name(static_cast<operation>(i)) << std::right
+                << std::setw(10) << h.count() << std::setw(10) << static_cast<std::uint64_t>(h.mean());
+            for (double p : {50.0, 90.0, 99.0, 99.9, 99.99})
+                out << std::setw(10) << h.percentile(p);
+            out << std::setw(10) << h.max() << '\n';
+        }
+    }
+
+private:
+    histogram per_operation[operation_count];
+};
+
+// Histogramy należące do obiektu FunctionMaxima. Opisują operacje
+// wykonane na tym obiekcie, więc kopia zaczyna od pustych, a przypisanie
+// (i swap funkcji) ich nie przenosi.
+class recorder {
+public:
+    recorder() : h(std::make_unique<histograms>()) {}
+    recorder(recorder const&) : recorder() {}
+    recorder& operator=(recorder const&) noexcept {
+        return *this;
+    }
+
+    histograms& get() const noexcept {
+        return *h;
+    }
+
+private:
+    std::unique_ptr<histograms> h;
+};
+
+// Mierzy czas od utworzenia do zniszczenia (także przez wyjątek)
+// i zapisuje go w histogramie operacji op.
+class scope {
+public:
+    using clock = std::chrono::steady_clock;
+
+    scope(recorder const& r, operation op) noexcept : h(r.get()), op(op), start(clock::now()) {}
+    scope(scope const&) = delete;
+    scope& operator=(scope const&) = delete;
+
+    ~scope() {
+        auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - start).count();
+        h[op].record(static_cast<std::uint64_t>(ns));
+    }
+
+    // Zmienia mierzoną operację, gdy wiadomo to dopiero po wyszukiwaniu.
+    void reclassify(operation o) noexcept {
+        op = o;
+    }
+
+private:
+    histograms& h;
+    operation op;
+    clock::time_point start;
+};
+
+} // namespace maxima_latency
+
+#endif //MAKSIMA_LATENCY_HISTOGRAM_H
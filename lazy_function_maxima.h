@@ -0,0 +1,300 @@
+#ifndef MAKSIMA_LAZY_FUNCTION_MAXIMA_H
+#define MAKSIMA_LAZY_FUNCTION_MAXIMA_H
+
+#include "function_maxima.h"
+
+#include <algorithm>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// FunctionMaxima z leniwym utrzymywaniem zbioru maksimów. set_value
+// i erase zmieniają od razu dziedzinę i wartości (odczyty dziedziny są
+// zawsze aktualne), a w zbiorze maksimów tylko dopisują do wektora brudny
+// przedział argumentów od lewego do prawego sąsiada zmienionego punktu.
+// Pierwszy odczyt maksimów (mx_begin, mx_end, mx_size, function) sortuje
+// i scala nakładające się przedziały, po czym przelicza status punktów
+// w nich. Gdy przedziały obejmują ponad jedną ósmą dziedziny albo zapisów
+// od ostatniego odczytu było więcej niż jedna szesnasta dziedziny, zbiór
+// maksimów jest budowany od nowa w czasie O(n log n) jednym sklejeniem
+// (liniowy przegląd jest kilka razy tańszy na punkt niż wyszukiwanie
+// w drzewie maksimów) - wtedy kolejne zapisy przestają cokolwiek zapisywać.
+template <typename A, typename V>
+class LazyFunctionMaxima {
+public:
+    using function_type = FunctionMaxima<A, V>;
+    using point_type = typename function_type::point_type;
+    using iterator = typename function_type::iterator;
+    using mx_iterator = typename function_type::mx_iterator;
+    using size_type = typename function_type::size_type;
+
+    LazyFunctionMaxima() = default;
+
+    explicit LazyFunctionMaxima(function_type f) : f(std::move(f)) {}
+
+    // Odczyty dziedziny - nie wymagają przeliczania maksimów.
+    iterator begin() const noexcept {
+        return f.begin();
+    }
+
+    iterator end() const noexcept {
+        return f.end();
+    }
+
+    iterator find(A const& a) const {
+        return f.find(a);
+    }
+
+    V const& value_at(A const& a) const {
+        return f.value_at(a);
+    }
+
+    size_type size() const noexcept {
+        return f.size();
+    }
+
+    // Jak w FunctionMaxima, ale bez porównań i zmian w zbiorze maksimów.
+    // Silna gwarancja.
+    void set_value(A const& a, V const& v);
+    void erase(A const& a);
+
+    // Przelicza maksima w brudnych przedziałach. Silna gwarancja - po
+    // wyjątku przedziały zostają brudne.
+    void refresh();
+
+    // Odczyty maksimów - najpierw refresh().
+    function_type const& function() {
+        refresh();
+        return f;
+    }
+
+    mx_iterator mx_begin() {
+        return function().mx_begin();
+    }
+
+    mx_iterator mx_end() {
+        return function().mx_end();
+    }
+
+    size_type mx_size() {
+        return function().mx_size();
+    }
+
+    // Liczba zapisanych (jeszcze nie scalonych) brudnych przedziałów.
+    size_type dirty_ranges() const noexcept {
+        return dirty.size();
+    }
+
+    // Czy najbliższy refresh() przebuduje cały zbiór maksimów.
+    bool all_dirty() const noexcept {
+        return everything_dirty;
+    }
+
+private:
+    using rg_iterator = typename function_type::rg_iterator;
+    using maxima_set = typename function_type::maxima_set;
+    using maxima_order = typename function_type::maxima_order;
+
+    function_type f;
+    // Brudne przedziały [lo, hi] argumentów w kolejności zapisów.
+    std::vector<std::pair<A, A>> dirty;
+    // Kopie punktów sprzed zmian od ostatniego refresh() - wpis w zbiorze
+    // maksimów może mieć tylko pierwsza kopia danego punktu.
+    std::vector<point_type> outdated;
+    bool everything_dirty = false;
+
+    // Zapisuje brudny przedział i kopię zmienianego punktu (o ile jest).
+    // Nadmiarowe wpisy niczego nie psują, więc wołamy to przed
+    // modyfikacjami funkcji.
+    void mark_dirty(A const& lo, A const& hi, point_type const* old);
+    void rebuild();
+    void patch(std::vector<std::pair<iterator, iterator>> const& ranges);
+};
+
+template <typename A, typename V>
+void LazyFunctionMaxima<A, V>::mark_dirty(A const& lo, A const& hi, point_type const* old) {
+    if (everything_dirty)
+        return;
+    if (dirty.size() >= std::max<size_type>(64, f.size() / 16)) {
+        everything_dirty = true;
+        dirty.clear();
+        outdated.clear();
+        return;
+    }
+    dirty.emplace_back(lo, hi);
+    if (old) {
+        try {
+            outdated.push_back(*old);
+        } catch (...) {
+            dirty.pop_back();
+            throw;
+        }
+    }
+}
+
+template <typename A, typename V>
+void LazyFunctionMaxima<A, V>::set_value(A const& a, V const& v) {
+    iterator right = f.fun.lower_bound(a);
+    bool found = right != f.end() && !(a < right->arg());
+    iterator it = found ? right : f.end();
+    if (found) {
+        if (!(it->value() < v) && !(v < it->value()))
+            return;
+        ++right;
+    }
+    iterator left = (found ? it : right) == f.begin() ? f.end() : std::prev(found ? it : right);
+    rg_iterator v_old = found ? f.rg_find(it->value()) : f.rg_end();
+
+    // Nadmiarowy brudny przedział ani nadmiarowa kopia niczego nie psują,
+    // więc zapisujemy je przed modyfikacjami funkcji.
+    mark_dirty(left != f.end() ? left->arg() : a, right != f.end() ? right->arg() : a,
+               found ? &*it : nullptr);
+
+    std::shared_ptr<A> a_ptr = found ? it->arg_ptr : std::make_shared<A>(a);
+    auto [v_new, v_inserted] = f.intern(v);
+    if (!found) {
+        try {
+            f.fun.insert_before(right, point_type{a_ptr, v_new->ptr});
+        } catch (...) {
+            if (v_inserted)
+                f.range.erase(v_new);
+            throw;
+        }
+    }
+
+    // Zatwierdzenie - już tylko operacje noexcept.
+    ++v_new->users;
+    if (found) {
+        it->replace_value(v_new->ptr);
+        f.release(v_old);
+    }
+}
+
+template <typename A, typename V>
+void LazyFunctionMaxima<A, V>::erase(A const& a) {
+    iterator it = f.find(a);
+    if (it == f.end())
+        return;
+    iterator left = it == f.begin() ? f.end() : std::prev(it);
+    iterator right = std::next(it);
+    rg_iterator rg_it = f.rg_find(it->value());
+
+    mark_dirty(left != f.end() ? left->arg() : a, right != f.end() ? right->arg() : a, &*it);
+
+    f.fun.erase(it);
+    f.release(rg_it);
+}
+
+template <typename A, typename V>
+void LazyFunctionMaxima<A, V>::refresh() {
+    if (everything_dirty) {
+        rebuild();
+        everything_dirty = false;
+        return;
+    }
+    if (dirty.empty() && outdated.empty())
+        return;
+
+    // Sortujemy kopię, żeby po wyjątku przedziały zostały nienaruszone.
+    std::vector<std::pair<A, A> const*> order;
+    order.reserve(dirty.size());
+    for (auto const& d : dirty)
+        order.push_back(&d);
+    std::sort(order.begin(), order.end(), [](auto const* x, auto const* y) {
+        return x->first < y->first;
+    });
+    // Scalone przedziały jako zakresy punktów: nakładające się przedziały
+    // dają nakładające się zakresy, więc scalamy je po pozycjach.
+    std::vector<std::pair<iterator, iterator>> ranges;
+    size_type covered = 0;
+    size_type last_rank = 0;
+    for (auto const* d : order) {
+        iterator first = f.fun.lower_bound(d->first);
+        iterator last = f.fun.upper_bound(d->second);
+        size_type first_rank = f.fun.rank(first);
+        size_type end_rank = f.fun.rank(last);
+        if (first_rank >= end_rank)
+            continue;
+        if (!ranges.empty() && first_rank <= last_rank) {
+            if (end_rank > last_rank) {
+                covered += end_rank - last_rank;
+                ranges.back().second = last;
+                last_rank = end_rank;
+            }
+            continue;
+        }
+        ranges.emplace_back(first, last);
+        covered += end_rank - first_rank;
+        last_rank = end_rank;
+    }
+    if (covered > f.size() / 8)
+        rebuild();
+    else
+        patch(ranges);
+    dirty.clear();
+    outdated.clear();
+}
+
+template <typename A, typename V>
+void LazyFunctionMaxima<A, V>::rebuild() {
+    std::vector<point_type> peaks;
+    for (iterator it = f.begin(); it != f.end(); ++it) {
+        if (f.left_check(it) && f.right_check(it))
+            peaks.push_back(*it);
+    }
+    std::stable_sort(peaks.begin(), peaks.end(), maxima_order());
+    maxima_set fresh;
+    fresh.insert_sorted_before(fresh.end(), peaks.begin(), peaks.end());
+    f.maxima.swap(fresh);
+}
+
+template <typename A, typename V>
+void LazyFunctionMaxima<A, V>::patch(std::vector<std::pair<iterator, iterator>> const& ranges) {
+    // Najpierw wpisy sprzed zmian. Ten sam wpis mogą wskazać kopie dwóch
+    // punktów o tym samym argumencie (usuniętego i wstawionego ponownie).
+    std::vector<mx_iterator> to_erase;
+    std::unordered_map<point_type const*, size_type> scheduled;
+    for (point_type const& p : outdated) {
+        mx_iterator mx = f.maxima.find(p);
+        if (mx != f.mx_end() && scheduled.emplace(&*mx, to_erase.size()).second)
+            to_erase.push_back(mx);
+    }
+
+    std::vector<point_type> to_insert;
+    for (auto const& [first, last] : ranges) {
+        for (iterator it = first; it != last; ++it) {
+            bool will = f.left_check(it) && f.right_check(it);
+            mx_iterator mx = f.maxima.find(*it);
+            if (mx == f.mx_end()) {
+                if (will)
+                    to_insert.push_back(*it);
+                continue;
+            }
+            auto known = scheduled.find(&*mx);
+            if (known != scheduled.end()) {
+                // Wpis sprzed zmian pasuje do obecnej wartości punktu.
+                if (will)
+                    to_erase[known->second] = f.mx_end();
+            } else if (!will) {
+                to_erase.push_back(mx);
+            }
+        }
+    }
+
+    std::vector<mx_iterator> inserted;
+    inserted.reserve(to_insert.size());
+    try {
+        for (point_type const& p : to_insert)
+            inserted.push_back(f.maxima.insert(p).first);
+    } catch (...) {
+        for (mx_iterator mx : inserted)
+            f.maxima.erase(mx);
+        throw;
+    }
+    for (mx_iterator mx : to_erase) {
+        if (mx != f.mx_end())
+            f.maxima.erase(mx);
+    }
+}
+
+#endif //MAKSIMA_LAZY_FUNCTION_MAXIMA_H
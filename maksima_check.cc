@@ -0,0 +1,838 @@
+// Sprawdzenie pomocniczych struktur na losowych ciągach operacji względem
+// naiwnych wyroczni, które liczą lokalne maksima od nowa wprost
+// z definicji. Porównanie wartości zgłasza wyjątek z małym
+// prawdopodobieństwem; po każdym takim wyjątku sprawdzamy, że stan się nie
+// zmienił (silna gwarancja), a poza tym porównujemy cały stan co
+// check_every operacji i na końcu. Uruchamiany ręcznie, nie przez ctest.
+//
+// Użycie: maksima_check [operacje] [ziarno]
+
+#include "compressed_function_maxima.h"
+#include "decayed_function_maxima.h"
+#include "function_maxima_n.h"
+#include "graph_maxima.h"
+#include "grid_maxima.h"
+#include "update_queue.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <exception>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <random>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace {
+
+constexpr std::size_t check_every = 100;
+
+// Wstrzykiwanie wyjątków do operator<; wyłączone podczas sprawdzania.
+bool injecting = false;
+std::uint64_t rng_state = 1;
+std::uint64_t injected_count = 0;
+
+struct injected : std::exception {
+    char const* what() const noexcept override {
+        return "injected comparison failure";
+    }
+};
+
+// xorshift64*; true z prawdopodobieństwem 1/1024.
+bool draw_failure(std::uint64_t& state) {
+    state ^= state >> 12;
+    state ^= state << 25;
+    state ^= state >> 27;
+    return (state * 0x2545f4914f6cdd1d) >> 54 == 0;
+}
+
+struct probe {
+    std::int64_t x;
+
+    friend bool operator<(probe a, probe b) {
+        if (injecting && draw_failure(rng_state)) {
+            ++injected_count;
+            throw injected();
+        }
+        return a.x < b.x;
+    }
+};
+
+// Argument dla UpdateQueue, którego porównania wykonuje wątek aplikujący
+// kolejki: flaga i licznik są atomowe, a każdy wątek ma własny generator.
+struct queue_probe {
+    std::int64_t x;
+
+    static inline std::atomic<bool> injecting{false};
+    static inline std::atomic<std::uint64_t> injected_count{0};
+
+    friend bool operator<(queue_probe a, queue_probe b) {
+        thread_local std::uint64_t state = 1;
+        if (injecting.load(std::memory_order_relaxed) && draw_failure(state)) {
+            injected_count.fetch_add(1, std::memory_order_relaxed);
+            throw injected();
+        }
+        return a.x < b.x;
+    }
+};
+
+// Wykonuje op z wstrzykiwaniem wyjątków. Zwraca false, gdy op zgłosiło
+// wstrzyknięty wyjątek.
+template <typename Op>
+bool attempt(Op&& op) {
+    injecting = true;
+    try {
+        op();
+    } catch (injected const&) {
+        injecting = false;
+        return false;
+    }
+    injecting = false;
+    return true;
+}
+
+using point = std::pair<std::int64_t, std::int64_t>;
+
+// Lokalne maksima ciągu punktów (posortowanego po argumentach) w kolejności
+// mx_begin(): malejąco po wartościach, przy równych rosnąco po argumentach.
+template <typename K, typename W>
+std::vector<std::pair<K, W>> sorted_maxima(std::vector<std::pair<K, W>> mx) {
+    std::sort(mx.begin(), mx.end(), [](auto const& p, auto const& q) {
+        return q.second < p.second || (p.second == q.second && p.first < q.first);
+    });
+    return mx;
+}
+
+template <typename W>
+std::vector<std::pair<std::int64_t, W>> line_maxima(std::vector<std::pair<std::int64_t, W>> const& points) {
+    std::vector<std::pair<std::int64_t, W>> mx;
+    for (std::size_t i = 0; i < points.size(); ++i) {
+        if (i > 0 && points[i].second < points[i - 1].second)
+            continue;
+        if (i + 1 < points.size() && points[i].second < points[i + 1].second)
+            continue;
+        mx.push_back(points[i]);
+    }
+    return sorted_maxima(std::move(mx));
+}
+
+// Opis pierwszej różnicy między maksimami [first, last) (przekształconymi
+// przez entry na pary klucz-wartość) a oczekiwanymi albo pusty napis.
+template <typename K, typename W, typename It, typename Entry>
+std::string maxima_difference(std::vector<std::pair<K, W>> const& expected,
+                              It first, It last, Entry entry) {
+    std::size_t i = 0;
+    for (; first != last; ++first, ++i) {
+        if (i == expected.size())
+            return "more maxima than the " + std::to_string(expected.size()) + " expected";
+        if (entry(*first) != expected[i])
+            return "maximum " + std::to_string(i) + " differs from the expected one (value "
+                    + std::to_string(entry(*first).second) + ", expected "
+                    + std::to_string(expected[i].second) + ")";
+    }
+    if (i != expected.size())
+        return std::to_string(i) + " maxima, expected " + std::to_string(expected.size());
+    return "";
+}
+
+// Wynik jednego sprawdzenia; wypisuje podsumowanie w destruktorze.
+class report {
+public:
+    explicit report(char const* name) : name(name) {
+        injected_count = 0;
+    }
+    report(report const&) = delete;
+    report& operator=(report const&) = delete;
+
+    ~report() {
+        std::cout << name << ": " << operations << " operations, " << injected_count
+                  << " injected exceptions, " << (failure.empty() ? "ok" : "FAILED") << std::endl;
+    }
+
+    // Zapisuje pierwszą różnicę why (pusty napis - brak różnicy) po
+    // operacji i. Zwraca true, gdy wszystko się zgadza.
+    bool expect(std::size_t i, std::string const& why) {
+        if (why.empty() || !failure.empty())
+            return failure.empty();
+        failure = why;
+        std::cerr << "maksima_check: " << name << " differs after operation " << i << ": " << why
+                  << std::endl;
+        return false;
+    }
+
+    bool ok() const noexcept {
+        return failure.empty();
+    }
+
+    std::size_t operations = 0;
+
+private:
+    char const* name;
+    std::string failure;
+};
+
+// FunctionMaximaN z dwoma kanałami: set_value, set_channel (InvalidArg poza
+// dziedziną) i erase.
+bool check_channels(std::size_t count, std::mt19937_64& rng) {
+    report r("FunctionMaximaN");
+    using function = FunctionMaximaN<probe, probe, probe>;
+    function f;
+    std::map<std::int64_t, std::pair<std::int64_t, std::int64_t>> oracle;
+    std::int64_t keys = 300, values = 20;
+
+    auto difference = [&]() -> std::string {
+        if (f.size() != oracle.size())
+            return "size " + std::to_string(f.size()) + ", expected " + std::to_string(oracle.size());
+        std::vector<point> first, second;
+        auto it = f.begin();
+        for (auto const& [a, v] : oracle) {
+            if (it->arg().x != a || it->value<0>().x != v.first || it->value<1>().x != v.second)
+                return "point " + std::to_string(it->arg().x) + " differs from " + std::to_string(a);
+            first.emplace_back(a, v.first);
+            second.emplace_back(a, v.second);
+            ++it;
+        }
+        auto entry = [](auto const& p) { return point(p.arg().x, p.value().x); };
+        std::string why = maxima_difference(line_maxima(first), f.mx_begin<0>(), f.mx_end<0>(), entry);
+        if (why.empty())
+            why = maxima_difference(line_maxima(second), f.mx_begin<1>(), f.mx_end<1>(), entry);
+        return why;
+    };
+
+    for (std::size_t i = 0; i < count && r.ok(); ++i, ++r.operations) {
+        std::int64_t a = static_cast<std::int64_t>(rng() % keys);
+        std::int64_t v = static_cast<std::int64_t>(rng() % values);
+        std::int64_t w = static_cast<std::int64_t>(rng() % values);
+        bool present = oracle.count(a) != 0;
+        bool done = true;
+        switch (rng() % 4) {
+            case 0:
+                done = attempt([&] { f.set_value(probe{a}, probe{v}, probe{w}); });
+                if (done)
+                    oracle[a] = {v, w};
+                break;
+            case 1:
+            case 2: {
+                bool invalid = false;
+                bool channel = rng() % 2;
+                done = attempt([&] {
+                    try {
+                        if (channel)
+                            f.set_channel<1>(probe{a}, probe{v});
+                        else
+                            f.set_channel<0>(probe{a}, probe{v});
+                    } catch (InvalidArg const&) {
+                        invalid = true;
+                    }
+                });
+                if (done && invalid != !present)
+                    r.expect(i, "set_channel on an argument that is " + std::string(present ? "" : "not ")
+                                    + "in the domain " + (invalid ? "threw" : "did not throw"));
+                if (done && present)
+                    (channel ? oracle[a].second : oracle[a].first) = v;
+                break;
+            }
+            case 3:
+                done = attempt([&] { f.erase(probe{a}); });
+                if (done)
+                    oracle.erase(a);
+                break;
+        }
+        if (!done || (i + 1) % check_every == 0 || i + 1 == count)
+            r.expect(i, difference());
+    }
+    return r.ok();
+}
+
+// GridMaxima rows x cols z sąsiedztwem kind: set_value (InvalidArg poza
+// siatką) i load całej siatki. Wyrocznia sprawdza wszystkich sąsiadów każdej
+// komórki.
+bool check_grid(char const* name, std::size_t rows, std::size_t cols,
+                GridMaxima<probe>::neighborhood kind, std::size_t count, std::mt19937_64& rng) {
+    report r(name);
+    using cell = std::pair<std::size_t, std::size_t>;
+    GridMaxima<probe> g(rows, cols, probe{0}, kind);
+    std::vector<std::int64_t> oracle(rows * cols, 0);
+    std::int64_t values = 8;
+    int reach = kind == GridMaxima<probe>::neighborhood::eight ? 1 : 0;
+
+    auto difference = [&]() -> std::string {
+        std::vector<std::pair<cell, std::int64_t>> mx;
+        for (std::size_t i = 0; i < rows; ++i) {
+            for (std::size_t j = 0; j < cols; ++j) {
+                std::int64_t v = oracle[i * cols + j];
+                if (g.value_at(i, j).x != v)
+                    return "cell (" + std::to_string(i) + ", " + std::to_string(j) + ") differs";
+                bool is_max = true;
+                for (int di = -1; di <= 1; ++di) {
+                    for (int dj = -1; dj <= 1; ++dj) {
+                        if ((di != 0 && dj != 0 && !reach) || (di == 0 && dj == 0))
+                            continue;
+                        std::size_t ni = i + di, nj = j + dj;  // poza siatką: przekręcone
+                        if (ni < rows && nj < cols && v < oracle[ni * cols + nj])
+                            is_max = false;
+                    }
+                }
+                if (is_max)
+                    mx.emplace_back(cell(i, j), v);
+            }
+        }
+        return maxima_difference(sorted_maxima(std::move(mx)), g.mx_begin(), g.mx_end(),
+                                 [](auto const& p) {
+                                     return std::make_pair(cell(p.row(), p.col()), p.value().x);
+                                 });
+    };
+
+    for (std::size_t i = 0; i < count && r.ok(); ++i, ++r.operations) {
+        bool done = true;
+        if (rng() % 200 == 0) {
+            std::vector<std::int64_t> fresh(rows * cols);
+            std::vector<probe> cells(rows * cols);
+            for (std::size_t c = 0; c < fresh.size(); ++c) {
+                fresh[c] = static_cast<std::int64_t>(rng() % values);
+                cells[c] = probe{fresh[c]};
+            }
+            done = attempt([&] { g.load(std::move(cells)); });
+            if (done)
+                oracle = std::move(fresh);
+        } else {
+            // Co dziesiąta komórka leży tuż za siatką.
+            std::size_t row = rng() % (rows + rows / 10 + 1);
+            std::size_t col = rng() % cols;
+            std::int64_t v = static_cast<std::int64_t>(rng() % values);
+            bool invalid = false;
+            done = attempt([&] {
+                try {
+                    g.set_value(row, col, probe{v});
+                } catch (InvalidArg const&) {
+                    invalid = true;
+                }
+            });
+            if (done && invalid != (row >= rows))
+                r.expect(i, "set_value(" + std::to_string(row) + ", " + std::to_string(col) + ") "
+                                + (invalid ? "threw" : "did not throw") + " InvalidArg");
+            if (done && !invalid)
+                oracle[row * cols + col] = v;
+        }
+        if (!done || (i + 1) % check_every == 0 || i + 1 == count)
+            r.expect(i, difference());
+    }
+    return r.ok();
+}
+
+// Siatki z zerowym wymiarem są puste i nie mają maksimów.
+bool check_empty_grids() {
+    report r("GridMaxima (empty)");
+    for (auto [rows, cols] : {std::pair<std::size_t, std::size_t>{2, 0}, {0, 3}, {0, 0}}) {
+        GridMaxima<probe> g(rows, cols, probe{0});
+        g.load({});
+        ++r.operations;
+        if (g.mx_size() != 0)
+            r.expect(r.operations, std::to_string(rows) + " x " + std::to_string(cols)
+                                           + " grid has maxima");
+    }
+    return r.ok();
+}
+
+// GraphMaxima na losowym grafie skierowanym (także z pętlami i powtórzonymi
+// krawędziami): set_value (InvalidArg dla nieistniejącego wierzchołka)
+// i odrzucanie niespójnego opisu CSR.
+bool check_graph(std::size_t count, std::mt19937_64& rng) {
+    report r("GraphMaxima");
+    std::size_t n = 200;
+    std::int64_t values = 10;
+    std::vector<std::size_t> offsets{0}, targets;
+    std::vector<std::int64_t> oracle(n);
+    std::vector<probe> initial(n);
+    for (std::size_t u = 0; u < n; ++u) {
+        for (std::size_t d = rng() % 7; d > 0; --d)
+            targets.push_back(rng() % n);
+        offsets.push_back(targets.size());
+        oracle[u] = static_cast<std::int64_t>(rng() % values);
+        initial[u] = probe{oracle[u]};
+    }
+    GraphMaxima<probe> g(offsets, targets, initial);
+
+    auto difference = [&]() -> std::string {
+        std::vector<std::pair<std::size_t, std::int64_t>> mx;
+        for (std::size_t u = 0; u < n; ++u) {
+            if (g.value_at(u).x != oracle[u])
+                return "value of node " + std::to_string(u) + " differs";
+            bool is_max = true;
+            for (std::size_t e = offsets[u]; e < offsets[u + 1]; ++e)
+                is_max &= !(oracle[u] < oracle[targets[e]]);
+            if (is_max)
+                mx.emplace_back(u, oracle[u]);
+        }
+        return maxima_difference(sorted_maxima(std::move(mx)), g.mx_begin(), g.mx_end(),
+                                 [](auto const& p) { return std::make_pair(p.node(), p.value().x); });
+    };
+
+    for (std::size_t i = 0; i < count && r.ok(); ++i, ++r.operations) {
+        std::size_t u = rng() % (n + n / 20);
+        std::int64_t v = static_cast<std::int64_t>(rng() % values);
+        bool invalid = false;
+        bool done = attempt([&] {
+            try {
+                g.set_value(u, probe{v});
+            } catch (InvalidArg const&) {
+                invalid = true;
+            }
+        });
+        if (done && invalid != (u >= n))
+            r.expect(i, "set_value(" + std::to_string(u) + ") " + (invalid ? "threw" : "did not throw")
+                            + " InvalidArg");
+        if (done && !invalid)
+            oracle[u] = v;
+        if (!done || (i + 1) % check_every == 0 || i + 1 == count)
+            r.expect(i, difference());
+    }
+
+    // Krawędź do nieistniejącego wierzchołka i malejące offsets.
+    for (auto [bad_offsets, bad_targets] :
+         {std::make_pair(std::vector<std::size_t>{0, 1}, std::vector<std::size_t>{1}),
+          std::make_pair(std::vector<std::size_t>{0, 2, 1}, std::vector<std::size_t>{0})}) {
+        bool invalid = false;
+        try {
+            GraphMaxima<probe>(bad_offsets, bad_targets,
+                               std::vector<probe>(bad_offsets.size() - 1, probe{0}));
+        } catch (InvalidArg const&) {
+            invalid = true;
+        }
+        r.expect(r.operations, invalid ? "" : "an inconsistent CSR description was accepted");
+    }
+    return r.ok();
+}
+
+// CompressedFunctionMaxima na losowych ciągach append (do pięciu bloków)
+// względem FunctionMaxima. Każdy ciąg losuje sposób wybierania różnic
+// argumentów (1, do 300, do 2^63 - różne długości varint) i wartości
+// (z {0, 1, 2}, błądzenie losowe, cały zakres, stała - różne szerokości
+// pakowania). Stan porównujemy przy granicach bloków, co check_every
+// operacji i na końcu ciągu: find, całą iterację, for_each_maximum,
+// for_each_maximum_at_least i mx_top.
+template <typename V>
+bool check_compressed(char const* name, std::size_t count, std::mt19937_64& rng) {
+    report r(name);
+    using compressed = CompressedFunctionMaxima<std::int64_t, V>;
+    using limits = std::numeric_limits<std::int64_t>;
+    constexpr std::size_t block = compressed::block_size;
+
+    while (r.operations < count && r.ok()) {
+        compressed c;
+        FunctionMaxima<std::int64_t, V> oracle;
+        unsigned gaps = rng() % 3, values = rng() % 4;
+        std::int64_t a = gaps == 2 ? limits::min() : static_cast<std::int64_t>(rng() % 2000) - 1000;
+        std::int64_t w = 0;
+
+        auto maxima = [](auto const& f, V const* threshold) {
+            std::vector<std::pair<std::int64_t, V>> mx;
+            auto add = [&](auto const& p) {
+                if (!threshold || !(p.value() < *threshold))
+                    mx.emplace_back(p.arg(), p.value());
+            };
+            if constexpr (std::is_same_v<std::decay_t<decltype(f)>, compressed>) {
+                if (threshold)
+                    f.for_each_maximum_at_least(*threshold, add);
+                else
+                    f.for_each_maximum(add);
+            } else {
+                std::for_each(f.mx_begin(), f.mx_end(), add);
+                std::sort(mx.begin(), mx.end());
+            }
+            return mx;
+        };
+        auto difference = [&]() -> std::string {
+            if (c.size() != oracle.size())
+                return "size " + std::to_string(c.size()) + ", expected " + std::to_string(oracle.size());
+            auto it = c.begin();
+            for (auto p = oracle.begin(); p != oracle.end(); ++p, ++it) {
+                if (it == c.end() || it->arg() != p->arg() || it->value() != p->value())
+                    return "point " + std::to_string(p->arg()) + " differs in iteration";
+                auto found = c.find(p->arg());
+                if (found == c.end() || found->arg() != p->arg() || found->value() != p->value())
+                    return "find(" + std::to_string(p->arg()) + ") differs";
+                // Argumenty tuż obok punktu, których nie ma w funkcji.
+                auto next = std::next(p);
+                for (std::int64_t b : {p->arg() - (p->arg() > limits::min()),
+                                       p->arg() + (p->arg() < limits::max())}) {
+                    bool present = b == p->arg() || (next != oracle.end() && b == next->arg())
+                            || (p != oracle.begin() && b == std::prev(p)->arg());
+                    if (!present && c.find(b) != c.end())
+                        return "find(" + std::to_string(b) + ") found a missing argument";
+                }
+            }
+            if (it != c.end())
+                return "more points than expected in iteration";
+            if (maxima(c, nullptr) != maxima(oracle, nullptr))
+                return "for_each_maximum differs";
+            if (oracle.mx_size() > 0) {
+                V top = oracle.mx_begin()->value();
+                std::vector<V> thresholds{oracle.begin()->value(), top};
+                if (top < std::numeric_limits<V>::max())
+                    thresholds.push_back(static_cast<V>(top + 1));
+                for (V threshold : thresholds) {
+                    if (maxima(c, &threshold) != maxima(oracle, &threshold))
+                        return "for_each_maximum_at_least differs";
+                }
+            }
+            auto top = c.mx_top();
+            if (oracle.mx_size() == 0 ? top != c.end()
+                                      : top == c.end() || top->arg() != oracle.mx_begin()->arg()
+                                                || top->value() != oracle.mx_begin()->value())
+                return "mx_top differs";
+            return "";
+        };
+
+        for (std::size_t length = 1 + rng() % (5 * block); length > 0 && r.operations < count && r.ok();
+             --length, ++r.operations) {
+            if (oracle.size() > 0 && rng() % 50 == 0) {
+                // Argument nie większy od ostatniego.
+                std::int64_t back = a - (a > limits::min() && rng() % 2 == 0);
+                bool invalid = false;
+                try {
+                    c.append(back, V());
+                } catch (InvalidArg const&) {
+                    invalid = true;
+                }
+                r.expect(r.operations, invalid ? difference() : "append(" + std::to_string(back) + ") was accepted");
+                continue;
+            }
+            if (oracle.size() > 0) {
+                std::uint64_t gap = gaps == 0 ? 1 : gaps == 1 ? 1 + rng() % 300 : 1 + (rng() >> (1 + rng() % 63));
+                if (gap > static_cast<std::uint64_t>(limits::max()) - static_cast<std::uint64_t>(a))
+                    break;
+                a = static_cast<std::int64_t>(static_cast<std::uint64_t>(a) + gap);
+            }
+            switch (values) {
+                case 0:
+                    w = static_cast<std::int64_t>(rng() % 3);
+                    break;
+                case 1:
+                    w += static_cast<std::int64_t>(rng() % 3) - 1;
+                    break;
+                case 2:
+                    w = static_cast<std::int64_t>(rng());
+                    break;
+                default:
+                    w = 7;
+                    break;
+            }
+            c.append(a, static_cast<V>(w));
+            oracle.set_value(a, static_cast<V>(w));
+            std::size_t edge = c.size() % block;
+            if (edge <= 1 || edge == block - 1 || (r.operations + 1) % check_every == 0)
+                r.expect(r.operations, difference());
+        }
+        r.expect(r.operations, difference());
+        // Ten sam stan zbudowany konstruktorem z FunctionMaxima.
+        c = compressed(oracle);
+        r.expect(r.operations, difference());
+    }
+    return r.ok();
+}
+
+// UpdateQueue z kilkoma producentami. Każdy producent ma własne argumenty
+// (a % producers), więc kolejność jego aktualizacji wyznacza wynik. Co
+// jakiś czas producent woła flush() i sprawdza, że funkcja ma już wszystkie
+// jego dotychczasowe aktualizacje; na końcu porównujemy całą funkcję
+// i maksima oraz liczniki w stats().
+bool check_queue(std::size_t count, std::uint64_t seed) {
+    report r("UpdateQueue");
+    constexpr std::size_t producers = 4;
+    std::int64_t keys = 400, values = 20;
+    std::vector<std::map<std::int64_t, std::int64_t>> expected(producers);
+    std::vector<std::string> failures(producers);
+    {
+        UpdateQueue<std::int64_t, std::int64_t> q(64);
+        std::vector<std::thread> threads;
+        for (std::size_t p = 0; p < producers; ++p) {
+            threads.emplace_back([&, p] {
+                std::mt19937_64 rng(seed + p);
+                auto& mine = expected[p];
+                for (std::size_t i = 0; i < count / producers; ++i) {
+                    std::int64_t a = static_cast<std::int64_t>(rng() % (keys / producers) * producers + p);
+                    if (rng() % 4 == 0) {
+                        q.submit_erase(a);
+                        mine.erase(a);
+                    } else {
+                        std::int64_t v = static_cast<std::int64_t>(rng() % values);
+                        q.submit(a, v);
+                        mine[a] = v;
+                    }
+                    if (i % 1000 != 999 || !failures[p].empty())
+                        continue;
+                    q.flush();
+                    failures[p] = q.read([&](auto const& f) -> std::string {
+                        for (std::int64_t b = static_cast<std::int64_t>(p); b < keys; b += producers) {
+                            auto it = f.find(b);
+                            auto want = mine.find(b);
+                            if ((it == f.end()) != (want == mine.end())
+                                || (it != f.end() && it->value() != want->second))
+                                return "argument " + std::to_string(b) + " differs after flush";
+                        }
+                        return "";
+                    });
+                }
+            });
+        }
+        for (std::thread& t : threads)
+            t.join();
+        q.flush();
+        for (std::size_t p = 0; p < producers; ++p)
+            r.expect(count, failures[p]);
+
+        std::map<std::int64_t, std::int64_t> all;
+        for (auto const& mine : expected)
+            all.insert(mine.begin(), mine.end());
+        std::vector<point> points(all.begin(), all.end());
+        r.expect(count, q.read([&](auto const& f) -> std::string {
+            if (f.size() != points.size())
+                return "size " + std::to_string(f.size()) + ", expected " + std::to_string(points.size());
+            if (!std::equal(points.begin(), points.end(), f.begin(), [](point const& x, auto const& y) {
+                    return x.first == y.arg() && x.second == y.value();
+                }))
+                return "function differs";
+            return maxima_difference(line_maxima(points), f.mx_begin(), f.mx_end(),
+                                     [](auto const& m) { return point(m.arg(), m.value()); });
+        }));
+        update_queue_stats st = q.stats();
+        r.operations = st.submitted;
+        if (st.submitted != count / producers * producers || st.failed != 0
+            || st.applied + st.coalesced != st.submitted || st.depth != 0)
+            r.expect(count, "stats: " + std::to_string(st.submitted) + " submitted, "
+                                    + std::to_string(st.applied) + " applied, "
+                                    + std::to_string(st.coalesced) + " coalesced, "
+                                    + std::to_string(st.failed) + " failed");
+    }
+    return r.ok();
+}
+
+// UpdateQueue z argumentami zgłaszającymi wyjątki przy scalaniu paczki
+// i w set_value / erase. Zawartości nie da się przewidzieć, więc
+// sprawdzamy, że każda aktualizacja została policzona dokładnie raz, każdy
+// wyjątek jako nieudana, że flush() nie zawiesza się i że maksima zgadzają
+// się z punktami funkcji.
+bool check_queue_failures(std::size_t count, std::uint64_t seed) {
+    report r("UpdateQueue (throwing comparisons)");
+    constexpr std::size_t producers = 4;
+    std::int64_t keys = 400, values = 20;
+    queue_probe::injected_count = 0;
+    {
+        UpdateQueue<queue_probe, std::int64_t> q(64);
+        queue_probe::injecting = true;
+        std::vector<std::thread> threads;
+        for (std::size_t p = 0; p < producers; ++p) {
+            threads.emplace_back([&, p] {
+                std::mt19937_64 rng(seed + p);
+                for (std::size_t i = 0; i < count / producers; ++i) {
+                    queue_probe a{static_cast<std::int64_t>(rng() % keys)};
+                    if (rng() % 4 == 0)
+                        q.submit_erase(a);
+                    else
+                        q.submit(a, static_cast<std::int64_t>(rng() % values));
+                    if (i % 1000 == 999)
+                        q.flush();
+                }
+            });
+        }
+        for (std::thread& t : threads)
+            t.join();
+        q.flush();
+        queue_probe::injecting = false;
+        injected_count = queue_probe::injected_count.load();
+
+        r.expect(count, q.read([&](auto const& f) -> std::string {
+            std::vector<point> points;
+            for (auto const& p : f)
+                points.emplace_back(p.arg().x, p.value());
+            return maxima_difference(line_maxima(points), f.mx_begin(), f.mx_end(),
+                                     [](auto const& m) { return point(m.arg().x, m.value()); });
+        }));
+        update_queue_stats st = q.stats();
+        r.operations = st.submitted;
+        if (st.submitted != count / producers * producers || st.failed != injected_count
+            || st.applied + st.coalesced + st.failed != st.submitted || st.depth != 0)
+            r.expect(count, "stats: " + std::to_string(st.submitted) + " submitted, "
+                                    + std::to_string(st.applied) + " applied, "
+                                    + std::to_string(st.coalesced) + " coalesced, "
+                                    + std::to_string(st.failed) + " failed, "
+                                    + std::to_string(injected_count) + " injected");
+    }
+    return r.ok();
+}
+
+// DecayedFunctionMaxima z argumentami zgłaszającymi wyjątki: set_value,
+// erase i decay_all, także z renormalizacją. Czynniki są potęgami dwójki,
+// a poziom wygaszenia (suma ich wykładników) pozostaje w [-300, 300], więc
+// wartości wyroczni są dokładne i nie wychodzą poza zakres double.
+bool check_decayed(std::size_t count, std::mt19937_64& rng) {
+    report r("DecayedFunctionMaxima");
+    using function = DecayedFunctionMaxima<probe, double>;
+    function f;
+    std::map<std::int64_t, double> oracle;
+    std::int64_t keys = 300, values = 20;
+    int level = 0;
+
+    auto compare = [](function const& f, std::map<std::int64_t, double> const& oracle) -> std::string {
+        if (f.size() != oracle.size())
+            return "size " + std::to_string(f.size()) + ", expected " + std::to_string(oracle.size());
+        std::vector<std::pair<std::int64_t, double>> points;
+        auto it = f.begin();
+        for (auto const& [a, v] : oracle) {
+            if (it->arg().x != a || f.actual(*it) != v)
+                return "point " + std::to_string(it->arg().x) + " differs from " + std::to_string(a);
+            points.emplace_back(a, v);
+            ++it;
+        }
+        return maxima_difference(line_maxima(points), f.mx_begin(), f.mx_end(),
+                                 [&](auto const& p) { return std::make_pair(p.arg().x, f.actual(p)); });
+    };
+    auto difference = [&] {
+        return compare(f, oracle);
+    };
+
+    for (std::size_t i = 0; i < count && r.ok(); ++i, ++r.operations) {
+        std::int64_t a = static_cast<std::int64_t>(rng() % keys);
+        bool done = true;
+        std::uint64_t kind = rng() % 20;
+        if (kind < 12) {
+            auto v = static_cast<double>(rng() % values);
+            done = attempt([&] { f.set_value(probe{a}, v); });
+            if (done)
+                oracle[a] = v;
+        } else if (kind < 18) {
+            done = attempt([&] { f.erase(probe{a}); });
+            if (done)
+                oracle.erase(a);
+        } else {
+            int target = static_cast<int>(rng() % 601) - 300;
+            double factor = std::ldexp(1.0, target - level);
+            done = attempt([&] { f.decay_all(factor); });
+            if (done) {
+                level = target;
+                for (auto& entry : oracle)
+                    entry.second *= factor;
+            }
+        }
+        if (!done || (i + 1) % check_every == 0 || i + 1 == count)
+            r.expect(i, difference());
+    }
+
+    for (double factor : {0.0, -1.0, HUGE_VAL}) {
+        bool invalid = false;
+        try {
+            f.decay_all(factor);
+        } catch (InvalidArg const&) {
+            invalid = true;
+        }
+        r.expect(r.operations, invalid ? "" : "decay_all(" + std::to_string(factor) + ") was accepted");
+    }
+
+    // Renormalizacja, przy której wartość traci bity, buduje funkcję od
+    // nowa; losowy ciąg powyżej trzyma wartości z dala od tego zakresu.
+    // Wartości 1 + k * 2^-52 po wygaszeniu o 2^-1050 są zdenormalizowane
+    // i zaokrąglane raz - tak samo w wyroczni.
+    for (int round = 0; round < 20 && r.ok(); ++round) {
+        function g;
+        std::map<std::int64_t, double> expected;
+        auto step = [&](auto op, auto on_success) {
+            while (!attempt(op)) {
+                ++r.operations;
+                if (!r.expect(r.operations, compare(g, expected)))
+                    return;
+            }
+            ++r.operations;
+            on_success();
+        };
+        auto decay = [&](double factor) {
+            step([&] { g.decay_all(factor); }, [&] {
+                for (auto& entry : expected)
+                    entry.second *= factor;
+            });
+        };
+        for (std::int64_t a = 0; a < 100; a += 2) {
+            double v = 1 + static_cast<double>(rng() % 1000) * std::ldexp(1.0, -52);
+            step([&] { g.set_value(probe{a}, v); }, [&] { expected[a] = v; });
+        }
+        decay(std::ldexp(1.0, -250));
+        for (std::int64_t a = 1; a < 100; a += 2) {
+            auto v = static_cast<double>(rng() % values);
+            step([&] { g.set_value(probe{a}, v); }, [&] { expected[a] = v; });
+        }
+        decay(std::ldexp(1.0, -800));
+        r.expect(r.operations, compare(g, expected));
+    }
+
+    // set_value, dla którego v / scale() wychodzi poza zakres double (albo
+    // do zera): funkcja musi się najpierw zrenormalizować. Wartości
+    // nieskończone i NaN są odrzucane bez zmiany stanu.
+    for (int round = 0; round < 20 && r.ok(); ++round) {
+        function g;
+        std::map<std::int64_t, double> expected;
+        auto set = [&](std::int64_t a, double v) {
+            while (!attempt([&] { g.set_value(probe{a}, v); })) {
+                ++r.operations;
+                if (!r.expect(r.operations, compare(g, expected)))
+                    return;
+            }
+            ++r.operations;
+            expected[a] = v;
+            r.expect(r.operations, compare(g, expected));
+        };
+        for (std::int64_t a = 0; a < 100; a += 2)
+            set(a, static_cast<double>(rng() % values));
+        int sign = round % 2 == 0 ? -1 : 1;
+        g.decay_all(std::ldexp(1.0, 250 * sign));
+        for (auto& entry : expected)
+            entry.second = std::ldexp(entry.second, 250 * sign);
+        set(1 + 2 * static_cast<std::int64_t>(rng() % 50),
+            std::ldexp(1.0 + static_cast<double>(rng() % 8) / 8, -1000 * sign));
+        for (double v : {HUGE_VAL, -HUGE_VAL, std::nan("")}) {
+            bool invalid = false;
+            try {
+                g.set_value(probe{100}, v);
+            } catch (InvalidArg const&) {
+                invalid = true;
+            }
+            r.expect(r.operations, invalid ? compare(g, expected)
+                                           : "set_value(" + std::to_string(v) + ") was accepted");
+        }
+    }
+    return r.ok();
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    long count = argc > 1 ? std::atol(argv[1]) : 20000;
+    std::uint64_t seed = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 1;
+    if (count <= 0) {
+        std::cerr << "usage: maksima_check [operations] [seed]" << std::endl;
+        return 1;
+    }
+    std::mt19937_64 rng(seed);
+    rng_state = seed | 1;
+    auto n = static_cast<std::size_t>(count);
+
+    bool ok = true;
+    ok &= check_channels(n, rng);
+    ok &= check_grid("GridMaxima (4 neighbours)", 13, 17, GridMaxima<probe>::neighborhood::four,
+                     n, rng);
+    ok &= check_grid("GridMaxima (8 neighbours)", 13, 17, GridMaxima<probe>::neighborhood::eight,
+                     n, rng);
+    ok &= check_empty_grids();
+    ok &= check_graph(n, rng);
+    ok &= check_decayed(n, rng);
+    ok &= check_compressed<std::int64_t>("CompressedFunctionMaxima (integer values)", n, rng);
+    ok &= check_compressed<double>("CompressedFunctionMaxima (floating-point values)", n, rng);
+    ok &= check_queue(n, seed);
+    ok &= check_queue_failures(n, seed);
+    return ok ? 0 : 1;
+}
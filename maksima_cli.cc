@@ -0,0 +1,239 @@
+// Interaktywna konsola do przeglądania i profilowania FunctionMaxima
+// z argumentami i wartościami int64_t. Czyta polecenia ze standardowego
+// wejścia (albo z pliku podanego jako argument), po jednym w wierszu, i po
+// każdym wypisuje czas wykonania w nanosekundach oraz liczbę porównań.
+// Czas obejmuje samo zapytanie - bez wypisywania wyników.
+//
+// Użycie: maksima_cli [skrypt]
+
+#include "bulk_load.h"
+#include "checkpointed_function_maxima.h"
+#include "function_maxima.h"
+#include "work_stealing_pool.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+namespace {
+
+std::uint64_t comparisons = 0;
+
+// Liczba, która zlicza wywołania operator< - tak mierzymy koszt zapytań
+// w porównaniach niezależnie od czasu.
+struct counted {
+    std::int64_t x;
+
+    friend bool operator<(counted a, counted b) noexcept {
+        ++comparisons;
+        return a.x < b.x;
+    }
+};
+
+using function = FunctionMaxima<counted, counted>;
+using point = std::pair<std::int64_t, std::int64_t>;
+
+char const help[] =
+        "set A V          set the value at A to V\n"
+        "erase A          remove A from the domain\n"
+        "get A            value at A\n"
+        "range LO HI [N]  points with arguments in [LO, HI] (at most N)\n"
+        "maxima LO HI [N] local maxima with arguments in [LO, HI] (at most N)\n"
+        "top K            K largest local maxima\n"
+        "at_least V [N]   local maxima with values of at least V (at most N)\n"
+        "load FILE        replace the function with \"arg,value\" rows from FILE\n"
+        "restore DIR      replace the function with the checkpoints in DIR\n"
+        "clear            remove all points\n"
+        "stats            size, maxima, memory and comparison count\n"
+#ifdef MAKSIMA_LATENCY_HISTOGRAMS
+        "latency          latency percentiles of set_value, erase and find\n"
+#endif
+        "help             this help\n"
+        "quit             exit\n";
+
+// Wynik polecenia: komunikat i/lub lista punktów.
+struct result {
+    std::string message;
+    std::vector<point> points;
+    std::size_t total = 0;  // wszystkich pasujących punktów, gdy wiadomo
+};
+
+class console {
+public:
+    // Wykonuje jedno polecenie i wypisuje wynik na out. Zwraca false po quit.
+    bool run(std::string const& line, std::ostream& out) {
+        std::istringstream in(line);
+        std::string command;
+        if (!(in >> command) || command[0] == '#')
+            return true;
+        if (command == "quit" || command == "exit")
+            return false;
+        if (command == "help") {
+            out << help;
+            return true;
+        }
+
+        result r;
+        std::uint64_t comparisons_before = comparisons;
+        auto start = std::chrono::steady_clock::now();
+        try {
+            r = execute(command, in);
+        } catch (InvalidArg const&) {
+            r.message = "not found";
+        } catch (std::exception const& e) {
+            r.message = std::string("error: ") + e.what();
+        }
+        auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - start).count();
+        std::uint64_t used = comparisons - comparisons_before;
+
+        for (point const& p : r.points)
+            out << p.first << ' ' << p.second << '\n';
+        if (r.total > r.points.size())
+            out << "... " << r.total - r.points.size() << " more\n";
+        if (!r.message.empty())
+            out << r.message << '\n';
+        out << "# " << ns << " ns, " << used << " comparisons" << std::endl;
+        return true;
+    }
+
+private:
+    function f;
+    WorkStealingPool pool{0};
+    std::uint64_t commands = 0;
+
+    static std::int64_t number(std::istream& in) {
+        std::int64_t x;
+        if (!(in >> x))
+            throw std::invalid_argument("expected a number");
+        return x;
+    }
+
+    static std::size_t limit(std::istream& in) {
+        std::int64_t n;
+        return in >> n ? static_cast<std::size_t>(std::max<std::int64_t>(n, 0)) : SIZE_MAX;
+    }
+
+    static point plain(function::point_type const& p) {
+        return {p.arg().x, p.value().x};
+    }
+
+    // Punkt p (różny od end()) jest lokalnym maksimum, gdy żaden sąsiad nie
+    // ma większej wartości.
+    bool is_maximum(function::iterator p) const {
+        if (p != f.begin() && p->value() < std::prev(p)->value())
+            return false;
+        auto next = std::next(p);
+        return next == f.end() || !(p->value() < next->value());
+    }
+
+    void replace(FunctionMaxima<std::int64_t, std::int64_t> const& g) {
+        std::vector<std::pair<counted, counted>> points;
+        points.reserve(g.size());
+        for (auto const& p : g)
+            points.emplace_back(counted{p.arg()}, counted{p.value()});
+        f.assign_sorted(points.begin(), points.end());
+    }
+
+    result execute(std::string const& command, std::istream& in) {
+        ++commands;
+        result r;
+        if (command == "set") {
+            std::int64_t a = number(in);
+            f.set_value(counted{a}, counted{number(in)});
+        } else if (command == "erase") {
+            f.erase(counted{number(in)});
+        } else if (command == "get") {
+            r.message = std::to_string(f.value_at(counted{number(in)}).x);
+        } else if (command == "range" || command == "maxima") {
+            bool only_maxima = command == "maxima";
+            std::int64_t lo = number(in), hi = number(in);
+            std::size_t n = limit(in);
+            for (auto p = f.nth(f.rank(counted{lo})); p != f.end() && !(counted{hi} < p->arg()); ++p) {
+                if (only_maxima && !is_maximum(p))
+                    continue;
+                if (r.points.size() < n)
+                    r.points.push_back(plain(*p));
+                ++r.total;
+            }
+        } else if (command == "top") {
+            std::int64_t k = number(in);
+            for (auto p = f.mx_begin(); p != f.mx_end() && static_cast<std::int64_t>(r.points.size()) < k; ++p)
+                r.points.push_back(plain(*p));
+        } else if (command == "at_least") {
+            auto range = f.maxima_at_least(counted{number(in)});
+            std::size_t n = limit(in);
+            r.total = range.size();
+            for (auto p = range.begin(); p != range.end() && r.points.size() < n; ++p)
+                r.points.push_back(plain(*p));
+        } else if (command == "load" || command == "restore") {
+            std::string path;
+            if (!(in >> path))
+                throw std::invalid_argument("expected a path");
+            if (command == "load") {
+                // Parser pliku obsługuje tylko typy arytmetyczne.
+                FunctionMaxima<std::int64_t, std::int64_t> g;
+                auto stats = maxima_load::load_file(path, g, pool);
+                replace(g);
+                r.message = std::to_string(stats.rows) + " rows, " + std::to_string(stats.skipped)
+                        + " skipped";
+            } else {
+                function g = CheckpointedFunctionMaxima<counted, counted>::restore(path);
+                f.swap(g);
+            }
+            r.message += (r.message.empty() ? "" : ", ") + std::string("size ")
+                    + std::to_string(f.size());
+        } else if (command == "clear") {
+            function().swap(f);
+        } else if (command == "stats") {
+            std::ostringstream s;
+            s << "size " << f.size() << ", maxima " << f.mx_size() << ", memory "
+              << f.memory_bytes() << " B, comparisons " << comparisons << " in " << commands
+              << " commands";
+            r.message = s.str();
+#ifdef MAKSIMA_LATENCY_HISTOGRAMS
+        } else if (command == "latency") {
+            std::ostringstream s;
+            f.latencies().dump(s);
+            r.message = s.str();
+            r.message.pop_back();
+#endif
+        } else {
+            throw std::invalid_argument("unknown command " + command + " (try help)");
+        }
+        return r;
+    }
+};
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    std::ifstream script;
+    if (argc > 1) {
+        script.open(argv[1]);
+        if (!script) {
+            std::cerr << "maksima_cli: cannot read " << argv[1] << std::endl;
+            return 1;
+        }
+    }
+    std::istream& in = argc > 1 ? script : std::cin;
+    bool interactive = argc == 1 && ::isatty(0);
+
+    console c;
+    std::string line;
+    while (true) {
+        if (interactive)
+            std::cout << "> " << std::flush;
+        if (!std::getline(in, line) || !c.run(line, std::cout))
+            break;
+    }
+    return 0;
+}
@@ -0,0 +1,140 @@
+// Pomiar przepustowości wczytywania pliku z wierszami "arg,value" do
+// FunctionMaxima<int64_t, int64_t>: sekwencyjnie (parsowanie i set_value
+// na przemian w jednym wątku) oraz potokiem korutyn z ingest_pipeline.h.
+// Na końcu sprawdza, że potok dał tę samą funkcję co wersja sekwencyjna
+// i że opublikowane zmiany maksimów, odtworzone po kolei od pustego zbioru,
+// dają dokładnie zbiór maksimów wyliczony od nowa z wyniku.
+//
+// Użycie: maksima_ingest plik [rozmiar paczki]
+//         maksima_ingest --generate plik liczba_wierszy [ziarno]
+
+#include "ingest_pipeline.h"
+
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <random>
+#include <sstream>
+#include <string>
+
+namespace {
+
+using function = FunctionMaxima<std::int64_t, std::int64_t>;
+
+int generate(char const* path, long rows, unsigned seed) {
+    std::ofstream out(path);
+    if (!out) {
+        std::cerr << "maksima_ingest: cannot write " << path << std::endl;
+        return 1;
+    }
+    std::mt19937_64 rng(seed);
+    for (long i = 0; i < rows; ++i) {
+        out << rng() % (rows + 1) << ',' << rng() % 1000000 << '\n';
+    }
+    return 0;
+}
+
+void sequential(std::string_view text, function& f) {
+    char const* p = text.data();
+    char const* end = p + text.size();
+    while (p < end) {
+        char const* line_end = static_cast<char const*>(
+                std::memchr(p, '\n', static_cast<std::size_t>(end - p)));
+        if (line_end == nullptr)
+            line_end = end;
+        std::int64_t a, v;
+        auto [after_arg, arg_error] = std::from_chars(p, line_end, a);
+        if (arg_error == std::errc() && after_arg < line_end
+            && (*after_arg == ',' || *after_arg == '\t')
+            && std::from_chars(after_arg + 1, line_end, v).ec == std::errc())
+            f.set_value(a, v);
+        p = line_end + 1;
+    }
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    if (argc >= 4 && std::string(argv[1]) == "--generate")
+        return generate(argv[2], std::atol(argv[3]),
+                        argc > 4 ? static_cast<unsigned>(std::atol(argv[4])) : 1);
+    if (argc < 2) {
+        std::cerr << "usage: maksima_ingest file [batch]\n"
+                  << "       maksima_ingest --generate file rows [seed]" << std::endl;
+        return 1;
+    }
+    std::size_t batch = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 65536;
+
+    std::ifstream in(argv[1], std::ios::binary);
+    if (!in) {
+        std::cerr << "maksima_ingest: cannot read " << argv[1] << std::endl;
+        return 1;
+    }
+    std::stringstream buffer;
+    buffer << in.rdbuf();
+    std::string text = buffer.str();
+    long rows = std::count(text.begin(), text.end(), '\n');
+
+    using clock = std::chrono::steady_clock;
+    auto report = [rows](char const* name, clock::duration d, function const& f) {
+        double seconds = std::chrono::duration<double>(d).count();
+        std::cout << name << ": " << seconds << " s, "
+                  << static_cast<long>(rows / seconds) << " rows/s, size "
+                  << f.size() << ", maxima " << f.mx_size() << std::endl;
+    };
+
+    function seq;
+    auto start = clock::now();
+    sequential(text, seq);
+    report("sequential", clock::now() - start, seq);
+
+    // Zbiór maksimów odtwarzany ze zmian; consistent spada, gdy zmiana nie
+    // pasuje do niego (zniknięcie nieobecnego maksimum albo ponowne pojawienie
+    // się obecnego).
+    function piped;
+    long raised = 0, dropped = 0;
+    std::map<std::int64_t, std::int64_t> published;
+    bool consistent = true;
+    start = clock::now();
+    ingest::run_pipeline(std::string_view(text), piped,
+                         [&](ingest::maxima_delta<std::int64_t, std::int64_t> const& d) {
+                             ++(d.raised ? raised : dropped);
+                             auto it = published.find(d.arg);
+                             if (d.raised) {
+                                 consistent &= it == published.end();
+                                 published[d.arg] = d.value;
+                             } else {
+                                 consistent &= it != published.end() && it->second == d.value;
+                                 if (it != published.end())
+                                     published.erase(it);
+                             }
+                         },
+                         4096, batch);
+    report("pipeline", clock::now() - start, piped);
+    std::cout << "maxima deltas: " << raised << " raised, " << dropped << " dropped"
+              << std::endl;
+
+    bool same = seq.size() == piped.size() && seq.mx_size() == piped.mx_size()
+                && std::equal(seq.begin(), seq.end(), piped.begin(),
+                              [](auto const& x, auto const& y) {
+                                  return x.arg() == y.arg() && x.value() == y.value();
+                              });
+    if (!same) {
+        std::cerr << "maksima_ingest: pipeline result differs from sequential" << std::endl;
+        return 1;
+    }
+    std::map<std::int64_t, std::int64_t> recomputed;
+    for (auto it = piped.begin(); it != piped.end(); ++it) {
+        if (ingest::detail::is_maximum(piped, it))
+            recomputed.emplace(it->arg(), it->value());
+    }
+    if (!consistent || published != recomputed) {
+        std::cerr << "maksima_ingest: published maxima deltas do not match the maxima" << std::endl;
+        return 1;
+    }
+    return 0;
+}
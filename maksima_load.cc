@@ -0,0 +1,92 @@
+// Wczytywanie pliku z wierszami "arg,value" (albo "arg<TAB>value") do
+// FunctionMaxima<int64_t, int64_t> przez maxima_load::load_file: plik
+// zmapowany do pamięci, parsowany równolegle i wstawiany paczką. Z --verify
+// porównuje wynik z kolejnymi set_value w jednym wątku.
+//
+// Użycie: maksima_load [--verify] plik [wątki]
+// Plik testowy można wygenerować przez maksima_ingest --generate.
+
+#include "bulk_load.h"
+#include "work_stealing_pool.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+namespace {
+
+using function = FunctionMaxima<std::int64_t, std::int64_t>;
+
+void sequential(std::string_view text, function& f) {
+    char const* p = text.data();
+    char const* end = p + text.size();
+    while (p < end) {
+        char const* line_end = static_cast<char const*>(
+                std::memchr(p, '\n', static_cast<std::size_t>(end - p)));
+        if (line_end == nullptr)
+            line_end = end;
+        std::int64_t a, v;
+        auto [after_arg, arg_error] = std::from_chars(p, line_end, a);
+        if (arg_error == std::errc() && after_arg < line_end
+            && (*after_arg == ',' || *after_arg == '\t')
+            && std::from_chars(after_arg + 1, line_end, v).ec == std::errc())
+            f.set_value(a, v);
+        p = line_end + 1;
+    }
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    bool verify = argc > 1 && std::string(argv[1]) == "--verify";
+    int first = verify ? 2 : 1;
+    if (argc <= first) {
+        std::cerr << "usage: maksima_load [--verify] file [threads]" << std::endl;
+        return 1;
+    }
+    char const* path = argv[first];
+    std::size_t threads = argc > first + 1 ? std::strtoul(argv[first + 1], nullptr, 10) : 0;
+
+    WorkStealingPool pool(threads);
+    function f;
+    maxima_load::load_stats stats;
+    try {
+        stats = maxima_load::load_file(path, f, pool);
+    } catch (std::exception const& e) {
+        std::cerr << "maksima_load: " << e.what() << std::endl;
+        return 1;
+    }
+    std::cout << "threads: " << pool.concurrency() << ", bytes: " << stats.bytes
+              << ", rows: " << stats.rows << ", skipped: " << stats.skipped << '\n'
+              << "parse: " << stats.parse_seconds << " s, build: " << stats.build_seconds
+              << " s, " << static_cast<long>(stats.rows_per_second()) << " rows/s, size "
+              << f.size() << ", maxima " << f.mx_size() << std::endl;
+    if (!verify)
+        return 0;
+
+    maxima_load::mapped_file file(path);
+    function seq;
+    auto start = std::chrono::steady_clock::now();
+    sequential(file.text(), seq);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "sequential set_value: " << seconds << " s, "
+              << static_cast<long>(static_cast<double>(stats.rows) / seconds) << " rows/s"
+              << std::endl;
+
+    bool same = seq.size() == f.size() && seq.mx_size() == f.mx_size()
+                && std::equal(seq.begin(), seq.end(), f.begin(),
+                              [](auto const& x, auto const& y) {
+                                  return x.arg() == y.arg() && x.value() == y.value();
+                              })
+                && std::equal(seq.mx_begin(), seq.mx_end(), f.mx_begin(),
+                              [](auto const& x, auto const& y) {
+                                  return x.arg() == y.arg() && x.value() == y.value();
+                              });
+    if (!same) {
+        std::cerr << "maksima_load: result differs from sequential set_value" << std::endl;
+        return 1;
+    }
+    return 0;
+}
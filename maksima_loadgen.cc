@@ -0,0 +1,150 @@
+// Generator obciążenia dla maksima_server. Każde połączenie (osobny wątek)
+// wysyła paczki po depth żądań bez czekania na odpowiedzi, a potem odbiera
+// wszystkie odpowiedzi paczki. Mieszanka: 50% set, 40% value_at, 5% erase,
+// 5% top_k(10). Na koniec wypisuje łączną przepustowość.
+//
+// Użycie: maksima_loadgen [ścieżka gniazda] [liczba operacji na połączenie]
+//                         [głębokość potoku] [liczba połączeń]
+
+#include "maksima_protocol.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace {
+
+using namespace maksima_protocol;
+
+int connect_to(std::string const& path) {
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    if (fd < 0 || path.size() >= sizeof addr.sun_path)
+        return -1;
+    std::memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+    if (connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof addr) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+bool send_all(int fd, std::vector<char> const& buffer) {
+    std::size_t sent = 0;
+    while (sent < buffer.size()) {
+        ssize_t n = send(fd, buffer.data() + sent, buffer.size() - sent, MSG_NOSIGNAL);
+        if (n <= 0)
+            return false;
+        sent += n;
+    }
+    return true;
+}
+
+// Odbiera dokładnie count ramek odpowiedzi; zwraca liczbę błędów.
+long receive(int fd, std::size_t count, std::vector<char>& buffer) {
+    long errors = 0;
+    std::size_t have = 0, done = 0;
+    buffer.resize(1 << 16);
+    while (done < count) {
+        if (buffer.size() - have < sizeof(response_header))
+            buffer.resize(buffer.size() * 2);
+        ssize_t n = recv(fd, buffer.data() + have, buffer.size() - have, 0);
+        if (n <= 0)
+            return errors + static_cast<long>(count - done);
+        have += n;
+        std::size_t at = 0;
+        while (have - at >= sizeof(response_header)) {
+            response_header h;
+            std::memcpy(&h, buffer.data() + at, sizeof h);
+            if (have - at < h.size) {
+                if (h.size > buffer.size())
+                    buffer.resize(h.size * 2);
+                break;
+            }
+            if (h.code != status::ok && h.code != status::not_found)
+                ++errors;
+            at += h.size;
+            ++done;
+        }
+        std::memmove(buffer.data(), buffer.data() + at, have - at);
+        have -= at;
+    }
+    return errors;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    std::string path = argc > 1 ? argv[1] : default_socket_path;
+    long ops = argc > 2 ? std::atol(argv[2]) : 1000000;
+    long depth = argc > 3 ? std::atol(argv[3]) : 256;
+    int connections = argc > 4 ? std::atoi(argv[4]) : 1;
+    if (ops <= 0 || depth <= 0 || connections <= 0) {
+        std::cerr << "usage: maksima_loadgen [socket] [ops] [depth] [connections]" << std::endl;
+        return 1;
+    }
+
+    std::atomic<long> completed{0}, failed{0};
+    std::vector<std::thread> workers;
+    auto start = std::chrono::steady_clock::now();
+    for (int t = 0; t < connections; ++t) {
+        workers.emplace_back([&, t] {
+            int fd = connect_to(path);
+            if (fd < 0) {
+                std::perror("maksima_loadgen");
+                failed += ops;
+                return;
+            }
+            std::mt19937_64 rng(t + 1);
+            std::string name = "f" + std::to_string(t);
+            std::vector<char> out, in;
+            std::uint32_t id = 0;
+            for (long done = 0; done < ops;) {
+                long batch = std::min(depth, ops - done);
+                out.clear();
+                for (long i = 0; i < batch; ++i) {
+                    std::int64_t a = static_cast<std::int64_t>(rng() % 1000000);
+                    unsigned dice = rng() % 100;
+                    if (dice < 50)
+                        append_request(out, id++, op::set, name,
+                                       {a, static_cast<std::int64_t>(rng() % 1000)});
+                    else if (dice < 90)
+                        append_request(out, id++, op::value_at, name, {a});
+                    else if (dice < 95)
+                        append_request(out, id++, op::erase, name, {a});
+                    else
+                        append_request(out, id++, op::top_k, name, {10});
+                }
+                if (!send_all(fd, out)) {
+                    failed += ops - done;
+                    break;
+                }
+                failed += receive(fd, batch, in);
+                done += batch;
+                completed += batch;
+            }
+            close(fd);
+        });
+    }
+    for (std::thread& w : workers)
+        w.join();
+    double seconds = std::chrono::duration<double>(
+            std::chrono::steady_clock::now() - start).count();
+
+    std::cout << "ops: " << completed << ", errors: " << failed
+              << ", time: " << seconds << " s, throughput: "
+              << static_cast<long>(completed / seconds) << " ops/s" << std::endl;
+    return failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,128 @@
+#ifndef MAKSIMA_PROTOCOL_H
+#define MAKSIMA_PROTOCOL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <initializer_list>
+#include <string_view>
+#include <vector>
+
+// Binarny protokół serwera maksima_server. Klient może wysłać wiele ramek
+// bez czekania na odpowiedzi; serwer odpowiada na nie w tej samej
+// kolejności, a odpowiedź niesie identyfikator żądania.
+//
+// Ramka żądania: request_header, nazwa funkcji (name_size bajtów), a potem
+// argumenty operacji jako int64_t:
+//   set:      arg, value
+//   erase:    arg
+//   value_at: arg                  -> value
+//   top_k:    k                    -> count, (arg, value) * count
+//   range:    lo, hi, limit        -> count, (arg, value) * count
+// Ramka odpowiedzi: response_header i ewentualnie wyniki jako int64_t.
+// Liczby są zapisywane w porządku bajtów maszyny (gniazdo jest lokalne).
+namespace maksima_protocol {
+
+enum class op : std::uint8_t {
+    set = 1,
+    erase = 2,
+    value_at = 3,
+    top_k = 4,
+    range = 5,
+};
+
+enum class status : std::uint8_t {
+    ok = 0,
+    not_found = 1,
+    bad_request = 2,
+    error = 3,
+};
+
+struct request_header {
+    std::uint32_t size;      // rozmiar całej ramki w bajtach
+    std::uint32_t id;
+    op code;
+    std::uint8_t name_size;
+    std::uint16_t reserved;
+};
+
+struct response_header {
+    std::uint32_t size;      // rozmiar całej ramki w bajtach
+    std::uint32_t id;
+    status code;
+    std::uint8_t reserved[3];
+};
+
+inline constexpr char default_socket_path[] = "/tmp/maksima.sock";
+
+// Największa poprawna ramka żądania: najdłuższa nazwa i najwięcej
+// argumentów (range). Serwer zrywa połączenie, które zapowiada większą -
+// inaczej jeden nagłówek mógłby kazać mu buforować do 4 GiB.
+inline constexpr std::size_t max_request_size = sizeof(request_header) + UINT8_MAX
+                                                + 3 * sizeof(std::int64_t);
+
+// Liczba argumentów int64_t wymaganych przez operację (-1 dla nieznanej).
+inline int argument_count(op code) noexcept {
+    switch (code) {
+        case op::set:
+            return 2;
+        case op::erase:
+        case op::value_at:
+        case op::top_k:
+            return 1;
+        case op::range:
+            return 3;
+    }
+    return -1;
+}
+
+inline void append_raw(std::vector<char>& buffer, void const* data, std::size_t size) {
+    char const* bytes = static_cast<char const*>(data);
+    buffer.insert(buffer.end(), bytes, bytes + size);
+}
+
+inline void append_int(std::vector<char>& buffer, std::int64_t x) {
+    append_raw(buffer, &x, sizeof x);
+}
+
+inline std::int64_t read_int(char const* data) noexcept {
+    std::int64_t x;
+    std::memcpy(&x, data, sizeof x);
+    return x;
+}
+
+inline void append_request(std::vector<char>& buffer, std::uint32_t id, op code,
+                           std::string_view name,
+                           std::initializer_list<std::int64_t> args) {
+    request_header h{};
+    h.size = static_cast<std::uint32_t>(sizeof h + name.size()
+                                        + args.size() * sizeof(std::int64_t));
+    h.id = id;
+    h.code = code;
+    h.name_size = static_cast<std::uint8_t>(name.size());
+    append_raw(buffer, &h, sizeof h);
+    append_raw(buffer, name.data(), name.size());
+    for (std::int64_t x : args)
+        append_int(buffer, x);
+}
+
+// Dopisuje nagłówek odpowiedzi i zwraca jego pozycję, żeby po dopisaniu
+// wyników można było uzupełnić rozmiar (finish_response).
+inline std::size_t begin_response(std::vector<char>& buffer, std::uint32_t id,
+                                  status code) {
+    std::size_t at = buffer.size();
+    response_header h{};
+    h.id = id;
+    h.code = code;
+    append_raw(buffer, &h, sizeof h);
+    return at;
+}
+
+inline void finish_response(std::vector<char>& buffer, std::size_t at) noexcept {
+    std::uint32_t size = static_cast<std::uint32_t>(buffer.size() - at);
+    std::memcpy(buffer.data() + at + offsetof(response_header, size), &size, sizeof size);
+}
+
+} // namespace maksima_protocol
+
+#endif //MAKSIMA_PROTOCOL_H
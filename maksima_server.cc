@@ -0,0 +1,311 @@
+// Serwer udostępniający nazwane funkcje FunctionMaxima<int64_t, int64_t>
+// innym procesom przez gniazdo uniksowe (protokół w maksima_protocol.h).
+// Jeden wątek z pętlą epoll: z każdego połączenia czytamy co najwyżej
+// max_reads_per_event porcji, po każdej obsługujemy wszystkie kompletne
+// ramki i odsyłamy odpowiedzi na całą paczkę jednym zapisem. Bufor
+// wejściowy mieści najwyżej input_limit bajtów, a gdy klient nie odbiera
+// odpowiedzi i zaległe przekroczą output_high_water, przestajemy czytać
+// od niego żądania, aż zaległości spadną. Gdy klient zamknie swoją stronę
+// połączenia, odpowiadamy jeszcze na odebrane ramki i zamykamy połączenie
+// dopiero po wysłaniu wszystkich odpowiedzi.
+//
+// Użycie: maksima_server [ścieżka gniazda]
+
+#include "function_maxima.h"
+#include "maksima_protocol.h"
+
+#include <algorithm>
+#include <csignal>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace {
+
+using namespace maksima_protocol;
+using function = FunctionMaxima<std::int64_t, std::int64_t>;
+
+// Ograniczenia pamięci na połączenie (opis na początku pliku).
+constexpr std::size_t input_limit = 16 * max_request_size;
+constexpr std::size_t output_high_water = std::size_t(1) << 20;
+constexpr int max_reads_per_event = 16;
+
+volatile std::sig_atomic_t stop_requested = 0;
+
+void on_signal(int) {
+    stop_requested = 1;
+}
+
+struct connection {
+    int fd;
+    std::vector<char> in;
+    std::vector<char> out;
+    std::size_t out_sent = 0;
+    std::uint32_t watched = EPOLLIN;  // zdarzenia zgłoszone do epoll
+    bool peer_closed = false;         // klient nie wyśle już nic więcej
+
+    bool backlogged() const {
+        return out.size() - out_sent > output_high_water;
+    }
+};
+
+class server {
+public:
+    // Obsługuje wszystkie kompletne ramki z c.in, dopisując odpowiedzi do
+    // c.out. Zwraca false, gdy strumień jest uszkodzony (także gdy ramka
+    // zapowiada rozmiar większy niż max_request_size).
+    bool process(connection& c) {
+        std::size_t at = 0;
+        while (c.in.size() - at >= sizeof(request_header)) {
+            request_header h;
+            std::memcpy(&h, c.in.data() + at, sizeof h);
+            if (h.size < sizeof h + h.name_size || h.size > max_request_size)
+                return false;
+            if (c.in.size() - at < h.size)
+                break;
+            handle(h, c.in.data() + at, c.out);
+            at += h.size;
+        }
+        c.in.erase(c.in.begin(), c.in.begin() + at);
+        return true;
+    }
+
+private:
+    std::unordered_map<std::string, function> functions;
+
+    void handle(request_header const& h, char const* frame, std::vector<char>& out) {
+        std::string name(frame + sizeof h, h.name_size);
+        char const* args = frame + sizeof h + h.name_size;
+        std::size_t arg_bytes = h.size - sizeof h - h.name_size;
+        int needed = argument_count(h.code);
+        if (needed < 0 || arg_bytes != needed * sizeof(std::int64_t)) {
+            finish_response(out, begin_response(out, h.id, status::bad_request));
+            return;
+        }
+        auto arg = [&](int i) {
+            return read_int(args + i * sizeof(std::int64_t));
+        };
+
+        std::size_t response = out.size();
+        try {
+            auto it = functions.find(name);
+            switch (h.code) {
+                case op::set:
+                    if (it == functions.end())
+                        it = functions.emplace(name, function()).first;
+                    it->second.set_value(arg(0), arg(1));
+                    begin_response(out, h.id, status::ok);
+                    break;
+                case op::erase:
+                    if (it != functions.end())
+                        it->second.erase(arg(0));
+                    begin_response(out, h.id, status::ok);
+                    break;
+                case op::value_at:
+                    if (it == functions.end() || it->second.find(arg(0)) == it->second.end()) {
+                        begin_response(out, h.id, status::not_found);
+                    } else {
+                        begin_response(out, h.id, status::ok);
+                        append_int(out, it->second.value_at(arg(0)));
+                    }
+                    break;
+                case op::top_k:
+                    begin_response(out, h.id, status::ok);
+                    if (it == functions.end()) {
+                        append_int(out, 0);
+                    } else {
+                        function const& f = it->second;
+                        std::int64_t k = std::min<std::int64_t>(
+                                std::max<std::int64_t>(arg(0), 0),
+                                static_cast<std::int64_t>(f.mx_size()));
+                        append_int(out, k);
+                        auto mx = f.mx_begin();
+                        for (std::int64_t i = 0; i < k; ++i, ++mx) {
+                            append_int(out, mx->arg());
+                            append_int(out, mx->value());
+                        }
+                    }
+                    break;
+                case op::range:
+                    begin_response(out, h.id, status::ok);
+                    if (it == functions.end()) {
+                        append_int(out, 0);
+                    } else {
+                        function const& f = it->second;
+                        std::size_t count_at = out.size();
+                        append_int(out, 0);
+                        std::int64_t count = 0;
+                        for (auto p = f.nth(f.rank(arg(0)));
+                             p != f.end() && p->arg() <= arg(1) && count < arg(2); ++p) {
+                            append_int(out, p->arg());
+                            append_int(out, p->value());
+                            ++count;
+                        }
+                        std::memcpy(out.data() + count_at, &count, sizeof count);
+                    }
+                    break;
+            }
+        } catch (...) {
+            out.resize(response);
+            begin_response(out, h.id, status::error);
+        }
+        finish_response(out, response);
+    }
+};
+
+bool set_nonblocking(int fd) {
+    int flags = fcntl(fd, F_GETFL, 0);
+    return flags >= 0 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0;
+}
+
+// Wysyła zaległe odpowiedzi; zwraca false, gdy połączenie padło.
+bool flush(connection& c) {
+    while (c.out_sent < c.out.size()) {
+        ssize_t n = send(c.fd, c.out.data() + c.out_sent, c.out.size() - c.out_sent,
+                         MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                return true;
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+        c.out_sent += n;
+    }
+    c.out.clear();
+    c.out_sent = 0;
+    return true;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    std::string path = argc > 1 ? argv[1] : default_socket_path;
+
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    if (listener < 0 || path.size() >= sizeof addr.sun_path) {
+        std::cerr << "maksima_server: cannot create socket" << std::endl;
+        return 1;
+    }
+    std::memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+    unlink(path.c_str());
+    if (bind(listener, reinterpret_cast<sockaddr*>(&addr), sizeof addr) < 0
+        || listen(listener, SOMAXCONN) < 0 || !set_nonblocking(listener)) {
+        std::perror("maksima_server");
+        return 1;
+    }
+
+    int epoll_fd = epoll_create1(0);
+    epoll_event ev{};
+    ev.events = EPOLLIN;
+    ev.data.fd = listener;
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, listener, &ev);
+
+    std::signal(SIGINT, on_signal);
+    std::signal(SIGTERM, on_signal);
+
+    server srv;
+    std::unordered_map<int, connection> connections;
+    std::vector<char> chunk(input_limit);
+    epoll_event events[64];
+
+    auto close_connection = [&](int fd) {
+        epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
+        close(fd);
+        connections.erase(fd);
+    };
+    // Po zamknięciu przez klienta czekamy już tylko na możliwość zapisu -
+    // koniec strumienia zgłaszałby EPOLLIN bez przerwy. Tak samo, gdy
+    // klient zalega z odbiorem odpowiedzi.
+    auto watch = [&](connection& c) {
+        std::uint32_t wanted = EPOLLOUT;
+        if (!c.peer_closed && !c.backlogged())
+            wanted = c.out.empty() ? EPOLLIN : EPOLLIN | EPOLLOUT;
+        if (c.watched == wanted)
+            return;
+        epoll_event change{};
+        change.events = wanted;
+        change.data.fd = c.fd;
+        epoll_ctl(epoll_fd, EPOLL_CTL_MOD, c.fd, &change);
+        c.watched = wanted;
+    };
+
+    while (!stop_requested) {
+        int ready = epoll_wait(epoll_fd, events, 64, -1);
+        if (ready < 0) {
+            if (errno == EINTR)
+                continue;
+            std::perror("maksima_server");
+            break;
+        }
+        for (int i = 0; i < ready; ++i) {
+            int fd = events[i].data.fd;
+            if (fd == listener) {
+                int client;
+                while ((client = accept(listener, nullptr, nullptr)) >= 0) {
+                    set_nonblocking(client);
+                    epoll_event cev{};
+                    cev.events = EPOLLIN;
+                    cev.data.fd = client;
+                    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, client, &cev);
+                    connections.emplace(client, connection{client, {}, {}});
+                }
+                continue;
+            }
+
+            auto found = connections.find(fd);
+            if (found == connections.end())
+                continue;
+            connection& c = found->second;
+            bool alive = true;
+            if (!c.peer_closed && (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR))) {
+                // Po process() w c.in zostaje najwyżej niepełna ramka, więc
+                // zawsze jest miejsce na kolejną porcję.
+                for (int reads = 0; reads < max_reads_per_event && !c.backlogged(); ++reads) {
+                    ssize_t n = recv(fd, chunk.data(), input_limit - c.in.size(), 0);
+                    if (n > 0) {
+                        c.in.insert(c.in.end(), chunk.data(), chunk.data() + n);
+                        if (!srv.process(c)) {
+                            alive = false;
+                            break;
+                        }
+                        continue;
+                    }
+                    if (n < 0 && errno == EINTR)
+                        continue;
+                    if (n == 0)
+                        c.peer_closed = true;
+                    else if (errno != EAGAIN && errno != EWOULDBLOCK)
+                        alive = false;
+                    break;
+                }
+            }
+            if (alive)
+                alive = flush(c);
+            if (!alive || (c.peer_closed && c.out.empty())) {
+                close_connection(fd);
+                continue;
+            }
+            watch(c);
+        }
+    }
+
+    for (auto& [fd, c] : connections)
+        close(fd);
+    close(listener);
+    close(epoll_fd);
+    unlink(path.c_str());
+    return 0;
+}
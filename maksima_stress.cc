@@ -0,0 +1,392 @@
+// Różnicowy test obciążeniowy: długie losowe ciągi set_value, erase i find
+// wykonywane na każdej implementacji (FunctionMaxima, LazyFunctionMaxima,
+// DeferredFunctionMaxima, TolerantFunctionMaxima z eps = 0) i na naiwnej
+// wyroczni - std::map, z której lokalne maksima liczymy od nowa w O(n).
+// Porównanie argumentów i wartości zgłasza wyjątek z zadanym
+// prawdopodobieństwem; po każdym takim wyjątku sprawdzamy, że zawartość
+// i maksima się nie zmieniły (silna gwarancja), a poza tym porównujemy
+// całą zawartość co check_every operacji. Dla każdej implementacji
+// wypisujemy przepustowość (liczony jest tylko czas jej operacji i odczytu
+// maksimów przed sprawdzeniem, bez samego sprawdzania) i liczbę
+// wstrzykniętych wyjątków.
+//
+// FunctionMaxima przechodzi dodatkowo drugi ciąg, w którym są też
+// add_to_range, assign_range, apply_batch i apply_parallel (na puli
+// z trzema wątkami pomocniczymi, żeby kawałki paczki naprawdę wykonywały się
+// współbieżnie). Paczka wykonuje kilkadziesiąt porównań na aktualizację,
+// więc dla paczek prawdopodobieństwo wyjątku na porównanie dzielimy przez
+// 1/4 rozmiaru paczki - bez tego prawie żadna by się nie udała, a i tak
+// wyjątek zdarza się w co czwartej-co drugiej paczce.
+//
+// Użycie: maksima_stress [operacje] [argumenty] [p. wyjątku] [ziarno] [check_every]
+
+#include "deferred_function_maxima.h"
+#include "function_maxima.h"
+#include "lazy_function_maxima.h"
+#include "tolerant_function_maxima.h"
+#include "work_stealing_pool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <exception>
+#include <iostream>
+#include <map>
+#include <random>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace {
+
+// Wstrzykiwanie wyjątków do operator<; wyłączone podczas sprawdzania.
+// injecting i threshold zmienia tylko wątek główny między operacjami.
+bool injecting = false;
+std::uint64_t throw_threshold = 0;  // prawdopodobieństwo * 2^64
+std::uint64_t threshold = 0;        // próg dla bieżącej operacji
+std::atomic<std::uint64_t> rng_counter{1};
+
+struct injected : std::exception {
+    char const* what() const noexcept override {
+        return "injected comparison failure";
+    }
+};
+
+inline std::uint64_t next_random() noexcept {
+    // splitmix64 z atomowego licznika - tańszy od mt19937, żeby nie
+    // zaciemniać pomiaru, a wątki apply_parallel losują bez wyścigów.
+    // W jednym wątku ciąg jest powtarzalny.
+    constexpr std::uint64_t step = 0x9e3779b97f4a7c15;
+    std::uint64_t z = rng_counter.fetch_add(step, std::memory_order_relaxed) + step;
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+    return z ^ (z >> 31);
+}
+
+struct probe {
+    std::int64_t x;
+
+    friend bool operator<(probe a, probe b) {
+        if (injecting && next_random() < threshold)
+            throw injected();
+        return a.x < b.x;
+    }
+
+    // Dla absolute_tolerance.
+    friend probe operator+(probe a, probe b) noexcept {
+        return {a.x + b.x};
+    }
+};
+
+enum class kind { set, erase, find, add_range, assign_range, batch, parallel_batch };
+
+// Dla operacji na przedziałach a i hi to końce przedziału, a v - delta albo
+// nowa wartość.
+struct operation {
+    kind k;
+    std::int64_t a;
+    std::int64_t v;
+    std::int64_t hi = 0;
+    std::vector<std::pair<std::int64_t, std::int64_t>> batch;
+};
+
+std::string describe(operation const& op) {
+    std::ostringstream s;
+    switch (op.k) {
+        case kind::set:
+            s << "set_value(" << op.a << ", " << op.v << ")";
+            break;
+        case kind::erase:
+            s << "erase(" << op.a << ")";
+            break;
+        case kind::find:
+            s << "find(" << op.a << ")";
+            break;
+        case kind::add_range:
+            s << "add_to_range(" << op.a << ", " << op.hi << ", " << op.v << ")";
+            break;
+        case kind::assign_range:
+            s << "assign_range(" << op.a << ", " << op.hi << ", " << op.v << ")";
+            break;
+        case kind::batch:
+            s << "apply_batch(" << op.batch.size() << " updates)";
+            break;
+        case kind::parallel_batch:
+            s << "apply_parallel(" << op.batch.size() << " updates)";
+            break;
+    }
+    return s.str();
+}
+
+// Naiwna wyrocznia.
+class oracle {
+public:
+    void apply(operation const& op) {
+        switch (op.k) {
+            case kind::set:
+                points[op.a] = op.v;
+                break;
+            case kind::erase:
+                points.erase(op.a);
+                break;
+            case kind::find:
+                break;
+            case kind::add_range:
+            case kind::assign_range:
+                for (auto it = points.lower_bound(op.a); it != points.end() && it->first <= op.hi; ++it)
+                    it->second = op.k == kind::add_range ? it->second + op.v : op.v;
+                break;
+            case kind::batch:
+            case kind::parallel_batch:
+                for (auto const& [a, v] : op.batch)
+                    points[a] = v;
+                break;
+        }
+    }
+
+    std::map<std::int64_t, std::int64_t> const& domain() const noexcept {
+        return points;
+    }
+
+    // Lokalne maksima w kolejności mx_iterator: malejąco po wartościach,
+    // przy równych rosnąco po argumentach.
+    std::vector<std::pair<std::int64_t, std::int64_t>> maxima() const {
+        std::vector<std::pair<std::int64_t, std::int64_t>> mx;
+        for (auto it = points.begin(); it != points.end(); ++it) {
+            if (it != points.begin() && it->second < std::prev(it)->second)
+                continue;
+            if (std::next(it) != points.end() && it->second < std::next(it)->second)
+                continue;
+            mx.emplace_back(it->first, it->second);
+        }
+        std::sort(mx.begin(), mx.end(), [](auto const& p, auto const& q) {
+            return q.second < p.second || (p.second == q.second && p.first < q.first);
+        });
+        return mx;
+    }
+
+private:
+    std::map<std::int64_t, std::int64_t> points;
+};
+
+// Opis pierwszej różnicy między implementacją a wyrocznią albo pusty napis.
+template <typename Backend>
+std::string difference(Backend& b, oracle const& o) {
+    auto const& domain = o.domain();
+    if (b.size() != domain.size())
+        return "size " + std::to_string(b.size()) + ", expected " + std::to_string(domain.size());
+    auto it = b.begin();
+    for (auto const& [a, v] : domain) {
+        if (it->arg().x != a || it->value().x != v)
+            return "point " + std::to_string(it->arg().x) + " -> " + std::to_string(it->value().x)
+                    + ", expected " + std::to_string(a) + " -> " + std::to_string(v);
+        ++it;
+    }
+    auto mx = o.maxima();
+    if (b.mx_size() != mx.size())
+        return "maxima count " + std::to_string(b.mx_size()) + ", expected " + std::to_string(mx.size());
+    auto m = b.mx_begin();
+    for (auto const& [a, v] : mx) {
+        if (m->arg().x != a || m->value().x != v)
+            return "maximum " + std::to_string(m->arg().x) + " -> " + std::to_string(m->value().x)
+                    + ", expected " + std::to_string(a) + " -> " + std::to_string(v);
+        ++m;
+    }
+    return "";
+}
+
+std::vector<std::pair<probe, probe>> probes(operation const& op) {
+    std::vector<std::pair<probe, probe>> batch;
+    batch.reserve(op.batch.size());
+    for (auto const& [a, v] : op.batch)
+        batch.emplace_back(probe{a}, probe{v});
+    return batch;
+}
+
+// Operacje dostępne tylko w FunctionMaxima; ciąg z nimi dostaje tylko ona.
+void apply_extended(FunctionMaxima<probe, probe>& f, operation const& op) {
+    static WorkStealingPool pool(3);
+    switch (op.k) {
+        case kind::add_range:
+            f.add_to_range(probe{op.a}, probe{op.hi}, probe{op.v});
+            break;
+        case kind::assign_range:
+            f.assign_range(probe{op.a}, probe{op.hi}, probe{op.v});
+            break;
+        case kind::batch:
+            f.apply_batch(probes(op));
+            break;
+        case kind::parallel_batch:
+            f.apply_parallel(probes(op), pool);
+            break;
+        default:
+            break;
+    }
+}
+
+template <typename Backend>
+void apply_extended(Backend&, operation const&) {
+    std::abort();
+}
+
+struct outcome {
+    double seconds = 0;
+    std::uint64_t exceptions = 0;
+    std::uint64_t checks = 0;
+    bool ok = true;
+};
+
+template <typename Backend>
+outcome run(char const* name, Backend b, std::vector<operation> const& ops, std::uint64_t seed,
+            std::size_t check_every) {
+    using clock = std::chrono::steady_clock;
+    outcome result;
+    oracle o;
+    rng_counter = seed;
+    auto fail = [&](std::size_t i, std::string const& why) {
+        std::cerr << "maksima_stress: " << name << " differs after operation " << i << " ("
+                  << describe(ops[i]) << "): " << why << std::endl;
+        result.ok = false;
+    };
+
+    std::size_t done = 0;
+    for (std::size_t i = 0; i < ops.size() && result.ok; ++i, ++done) {
+        operation const& op = ops[i];
+        bool threw = false;
+        bool found = false;
+        std::int64_t value = 0;
+        threshold = throw_threshold / std::max<std::size_t>(1, op.batch.size() / 4);
+        auto start = clock::now();
+        injecting = true;
+        try {
+            switch (op.k) {
+                case kind::set:
+                    b.set_value(probe{op.a}, probe{op.v});
+                    break;
+                case kind::erase:
+                    b.erase(probe{op.a});
+                    break;
+                case kind::find: {
+                    auto it = b.find(probe{op.a});
+                    found = it != b.end();
+                    if (found)
+                        value = it->value().x;
+                    break;
+                }
+                default:
+                    apply_extended(b, op);
+                    break;
+            }
+        } catch (injected const&) {
+            threw = true;
+        }
+        injecting = false;
+        result.seconds += std::chrono::duration<double>(clock::now() - start).count();
+
+        if (threw) {
+            // Silna gwarancja: stan jak przed operacją.
+            ++result.exceptions;
+            ++result.checks;
+            if (std::string why = difference(b, o); !why.empty())
+                fail(i, "after an exception: " + why);
+            continue;
+        }
+        o.apply(op);
+        if (op.k == kind::find) {
+            auto it = o.domain().find(op.a);
+            if (found != (it != o.domain().end()) || (found && value != it->second))
+                fail(i, "wrong find result");
+        }
+        if ((i + 1) % check_every == 0 || i + 1 == ops.size()) {
+            // Lazy i Deferred odkładają pracę do odczytu maksimów - liczymy
+            // ją do czasu implementacji.
+            start = clock::now();
+            b.mx_begin();
+            result.seconds += std::chrono::duration<double>(clock::now() - start).count();
+            ++result.checks;
+            if (std::string why = difference(b, o); !why.empty())
+                fail(i, why);
+        }
+    }
+    double rate = result.seconds > 0 ? static_cast<double>(done) / result.seconds : 0;
+    std::cout << name << ": " << static_cast<long>(rate) << " ops/s, " << result.exceptions
+              << " injected exceptions, " << result.checks << " full checks, "
+              << (result.ok ? "ok" : "FAILED") << std::endl;
+    return result;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    long count = argc > 1 ? std::atol(argv[1]) : 200000;
+    std::int64_t keys = argc > 2 ? std::atoll(argv[2]) : 1000;
+    double probability = argc > 3 ? std::atof(argv[3]) : 0.001;
+    std::uint64_t seed = argc > 4 ? std::strtoull(argv[4], nullptr, 10) : 1;
+    std::size_t check_every = argc > 5 ? std::strtoul(argv[5], nullptr, 10) : 1000;
+    if (count <= 0 || keys <= 0 || probability < 0 || probability >= 1 || check_every == 0) {
+        std::cerr << "usage: maksima_stress [operations] [keys] [throw probability] [seed]"
+                  << " [check every]" << std::endl;
+        return 1;
+    }
+    throw_threshold = static_cast<std::uint64_t>(probability * 18446744073709551616.0);
+
+    // 55% set_value, 25% erase, 20% find; mało różnych wartości, żeby
+    // powstawały płaskowyże i remisy w porządku maksimów.
+    std::mt19937_64 rng(seed);
+    std::int64_t values = std::max<std::int64_t>(2, keys / 20);
+    auto random_below = [&](std::int64_t n) {
+        return static_cast<std::int64_t>(rng() % static_cast<std::uint64_t>(n));
+    };
+    std::vector<operation> ops(static_cast<std::size_t>(count));
+    for (auto& op : ops) {
+        std::uint64_t r = rng() % 20;
+        op.k = r < 11 ? kind::set : r < 16 ? kind::erase : kind::find;
+        op.a = random_below(keys);
+        op.v = random_below(values);
+    }
+
+    // Ciąg dla FunctionMaxima: 45% set_value, 20% erase, 15% find, po 9,5%
+    // add_to_range i assign_range na przedziałach do keys / 10 argumentów,
+    // 0,75% apply_batch po 1-64 aktualizacji i 0,25% apply_parallel po 4096
+    // - tyle, żeby paczka dzieliła się na kilka kawałków po co najmniej 1024
+    // (ich argumenty sięgają dalej niż keys, jeśli keys jest mniejsze).
+    std::int64_t batch_keys = std::max<std::int64_t>(keys, 4096);
+    std::vector<operation> extended(static_cast<std::size_t>(count));
+    for (auto& op : extended) {
+        std::uint64_t r = rng() % 400;
+        op.k = r < 180 ? kind::set : r < 260 ? kind::erase : r < 320 ? kind::find
+               : r < 358 ? kind::add_range : r < 396 ? kind::assign_range
+               : r < 399 ? kind::batch : kind::parallel_batch;
+        op.a = random_below(keys);
+        op.v = random_below(values);
+        if (op.k == kind::add_range || op.k == kind::assign_range) {
+            op.hi = op.a + random_below(keys / 10 + 1);
+            if (op.k == kind::add_range)
+                op.v = random_below(3) - 1;
+        } else if (op.k == kind::batch || op.k == kind::parallel_batch) {
+            std::size_t n = op.k == kind::batch ? 1 + rng() % 64 : 4096;
+            op.batch.resize(n);
+            for (auto& [a, v] : op.batch) {
+                a = random_below(op.k == kind::batch ? keys : batch_keys);
+                v = random_below(values);
+            }
+        }
+    }
+    std::cout << count << " operations on " << keys << " keys, throw probability " << probability
+              << " per comparison, seed " << seed << std::endl;
+
+    bool ok = true;
+    ok &= run("FunctionMaxima", FunctionMaxima<probe, probe>(), ops, seed, check_every).ok;
+    ok &= run("LazyFunctionMaxima", LazyFunctionMaxima<probe, probe>(), ops, seed, check_every).ok;
+    ok &= run("DeferredFunctionMaxima", DeferredFunctionMaxima<probe, probe>(), ops, seed,
+              check_every).ok;
+    ok &= run("TolerantFunctionMaxima (eps 0)",
+              TolerantFunctionMaxima<probe, probe>(absolute_tolerance<probe>{probe{0}}), ops, seed,
+              check_every).ok;
+    ok &= run("FunctionMaxima (ranges, batches)", FunctionMaxima<probe, probe>(), extended, seed,
+              check_every).ok;
+    return ok ? 0 : 1;
+}
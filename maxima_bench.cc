@@ -0,0 +1,773 @@
+// Pomiary wydajności FunctionMaxima. Pierwszy argument wybiera pomiar:
+//
+//   maxima_bench reduce [liczba maksimów] [największa liczba wątków]
+//       skalowanie for_each_maximum i reduce_maxima z polityką par
+//       względem seq (suma wartości maksimów i histogram ich wysokości)
+//   maxima_bench lazy [liczba punktów] [liczba zapisów]
+//       LazyFunctionMaxima względem FunctionMaxima dla różnych proporcji
+//       zapisów do odczytów maksimów
+//   maxima_bench jitter [liczba punktów] [liczba zapisów] [eps]
+//       TolerantFunctionMaxima względem FunctionMaxima dla gładkiego
+//       sygnału z szumem: czas zapisu i liczba zmian w zbiorze maksimów
+//   maxima_bench compressed [liczba punktów]
+//       CompressedFunctionMaxima dla znaczników czasu z wolnozmiennymi
+//       wartościami: bajty na punkt, find, przegląd i zapytania o maksima
+//   maxima_bench checkpoint [liczba punktów] [liczba zmian]
+//       czas delty i pełnej bazy w CheckpointedFunctionMaxima oraz
+//       odtworzenia funkcji (w katalogu tymczasowym)
+//   maxima_bench latency [liczba punktów] [liczba operacji]
+//       losowa mieszanka set_value, erase i find: średni czas operacji,
+//       a w kompilacji z MAKSIMA_LATENCY_HISTOGRAMS także percentyle
+//       czasów poszczególnych operacji
+//   maxima_bench counters [liczba punktów]
+//       liczniki sprzętowe (cykle, instrukcje, chybienia L1D i LLC, błędne
+//       przewidywania skoków) na operację dla kolejnych paczek operacji
+//       FunctionMaxima; bez dostępu do perf_event tylko czas
+//   maxima_bench allocations [liczba punktów]
+//       liczba alokacji i zaalokowanych bajtów na operację (set_value,
+//       erase, find, kopia, przegląd), zliczanych przez globalny operator
+//       new tego programu
+//   maxima_bench rollback [największa liczba punktów] [liczba operacji] [p]
+//       koszt wycofywania zmian: set_value i erase dla wartości, których
+//       operator< zgłasza wyjątek z prawdopodobieństwem p, osobno dla
+//       operacji udanych i przerwanych, dla rosnących rozmiarów funkcji
+
+#include "checkpointed_function_maxima.h"
+#include "compressed_function_maxima.h"
+#include "function_maxima.h"
+#include "lazy_function_maxima.h"
+#include "perf_counters.h"
+#include "tolerant_function_maxima.h"
+#include "work_stealing_pool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <exception>
+#include <filesystem>
+#include <iomanip>
+#include <iostream>
+#include <new>
+#include <random>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <unistd.h>
+
+// Zliczanie alokacji całego programu dla pomiaru allocations: globalny
+// operator new (także nothrow) podmieniamy na malloc z licznikami. Wersje
+// z wyrównaniem zostają domyślne i mają własną parę new/delete.
+namespace {
+
+std::atomic<std::uint64_t> allocation_count{0};
+std::atomic<std::uint64_t> allocated_bytes{0};
+std::atomic<std::uint64_t> deallocation_count{0};
+
+void* counted_allocation(std::size_t size) {
+    allocation_count.fetch_add(1, std::memory_order_relaxed);
+    allocated_bytes.fetch_add(size, std::memory_order_relaxed);
+    if (void* p = std::malloc(size == 0 ? 1 : size))
+        return p;
+    throw std::bad_alloc();
+}
+
+void counted_deallocation(void* p) noexcept {
+    if (p != nullptr) {
+        deallocation_count.fetch_add(1, std::memory_order_relaxed);
+        std::free(p);
+    }
+}
+
+} // namespace
+
+void* operator new(std::size_t size) {
+    return counted_allocation(size);
+}
+
+void* operator new[](std::size_t size) {
+    return counted_allocation(size);
+}
+
+void* operator new(std::size_t size, std::nothrow_t const&) noexcept {
+    try {
+        return counted_allocation(size);
+    } catch (std::bad_alloc const&) {
+        return nullptr;
+    }
+}
+
+void* operator new[](std::size_t size, std::nothrow_t const&) noexcept {
+    try {
+        return counted_allocation(size);
+    } catch (std::bad_alloc const&) {
+        return nullptr;
+    }
+}
+
+void operator delete(void* p) noexcept {
+    counted_deallocation(p);
+}
+
+void operator delete(void* p, std::nothrow_t const&) noexcept {
+    counted_deallocation(p);
+}
+
+void operator delete[](void* p, std::nothrow_t const&) noexcept {
+    counted_deallocation(p);
+}
+
+void operator delete[](void* p) noexcept {
+    counted_deallocation(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept {
+    counted_deallocation(p);
+}
+
+void operator delete[](void* p, std::size_t) noexcept {
+    counted_deallocation(p);
+}
+
+namespace {
+
+using function = FunctionMaxima<std::int64_t, std::int64_t>;
+using clock_type = std::chrono::steady_clock;
+
+double seconds_since(clock_type::time_point start) {
+    return std::chrono::duration<double>(clock_type::now() - start).count();
+}
+
+// Schodki szerokości 1000: wszystkie punkty poza ostatnim w każdym schodku
+// są lokalnymi maksimami, więc maksimów jest około 0.999 * points.
+function staircase(std::int64_t points) {
+    std::vector<std::pair<std::int64_t, std::int64_t>> batch;
+    batch.reserve(static_cast<std::size_t>(points));
+    for (std::int64_t i = 0; i < points; ++i)
+        batch.emplace_back(i, i / 1000);
+    WorkStealingPool pool;
+    function f;
+    f.apply_parallel(std::move(batch), pool);
+    return f;
+}
+
+int reduce(int argc, char* argv[]) {
+    std::int64_t maxima = argc > 2 ? std::atoll(argv[2]) : 10000000;
+    unsigned max_threads = argc > 3 ? static_cast<unsigned>(std::atoi(argv[3]))
+                                    : std::max(1u, std::thread::hardware_concurrency());
+    if (maxima <= 0 || max_threads == 0) {
+        std::cerr << "usage: maxima_bench reduce [maxima] [max threads]" << std::endl;
+        return 1;
+    }
+
+    auto start = clock_type::now();
+    function f = staircase(maxima + maxima / 999 + 1);
+    std::cout << "built " << f.size() << " points, " << f.mx_size() << " maxima in "
+              << seconds_since(start) << " s" << std::endl;
+
+    auto sum = [](std::int64_t x, std::int64_t y) { return x + y; };
+    start = clock_type::now();
+    std::int64_t expected = f.reduce_maxima(maxima_execution::seq, std::int64_t{0}, sum);
+    double base_reduce = seconds_since(start);
+
+    std::vector<std::atomic<std::int64_t>> histogram(64);
+    auto count_height = [&](function::point_type const& p) {
+        histogram[static_cast<std::size_t>(p.value()) % histogram.size()]
+                .fetch_add(1, std::memory_order_relaxed);
+    };
+    start = clock_type::now();
+    f.for_each_maximum(maxima_execution::seq, count_height);
+    double base_for_each = seconds_since(start);
+
+    std::cout << "threads  reduce[s]  speedup  for_each[s]  speedup" << std::endl;
+    std::cout << "seq      " << base_reduce << "  1  " << base_for_each << "  1" << std::endl;
+    for (unsigned t = 1; t <= max_threads; t *= 2) {
+        start = clock_type::now();
+        std::int64_t total = f.reduce_maxima(maxima_execution::par(t), std::int64_t{0}, sum);
+        double r = seconds_since(start);
+        start = clock_type::now();
+        f.for_each_maximum(maxima_execution::par(t), count_height);
+        double e = seconds_since(start);
+        if (total != expected) {
+            std::cerr << "maxima_bench: parallel sum " << total << " != " << expected << std::endl;
+            return 1;
+        }
+        std::cout << t << "        " << r << "  " << base_reduce / r << "  "
+                  << e << "  " << base_for_each / e << std::endl;
+        if (t < max_threads && t * 2 > max_threads)
+            t = max_threads / 2;
+    }
+    return 0;
+}
+
+// Losowe zapisy w dziedzinie 2 * points, po każdych ratio zapisach odczyt
+// największego maksimum. Zwraca czas w sekundach i sumę odczytów.
+template <typename F>
+std::pair<double, std::int64_t> mixed_workload(F& f, std::int64_t points, long writes,
+                                               long ratio) {
+    std::mt19937_64 rng(42);
+    std::int64_t checksum = 0;
+    auto start = clock_type::now();
+    for (long i = 1; i <= writes; ++i) {
+        f.set_value(static_cast<std::int64_t>(rng() % (2 * points)),
+                    static_cast<std::int64_t>(rng() % 1000));
+        if (i % ratio == 0)
+            checksum += f.mx_begin()->value() + static_cast<std::int64_t>(f.mx_size());
+    }
+    return {seconds_since(start), checksum};
+}
+
+int lazy(int argc, char* argv[]) {
+    std::int64_t points = argc > 2 ? std::atoll(argv[2]) : 100000;
+    long writes = argc > 3 ? std::atol(argv[3]) : 200000;
+    if (points <= 0 || writes <= 0) {
+        std::cerr << "usage: maxima_bench lazy [points] [writes]" << std::endl;
+        return 1;
+    }
+    std::mt19937_64 rng(7);
+    std::vector<std::pair<std::int64_t, std::int64_t>> batch;
+    for (std::int64_t i = 0; i < points; ++i)
+        batch.emplace_back(static_cast<std::int64_t>(rng() % (2 * points)),
+                           static_cast<std::int64_t>(rng() % 1000));
+    function initial;
+    initial.apply_batch(std::move(batch));
+
+    std::cout << "writes/read  eager[ns/write]  lazy[ns/write]  lazy/eager" << std::endl;
+    long crossover = 0;
+    for (long ratio = 1; ratio <= writes; ratio *= 4) {
+        function eager(initial);
+        LazyFunctionMaxima<std::int64_t, std::int64_t> deferred{function(initial)};
+        auto [eager_time, eager_sum] = mixed_workload(eager, points, writes, ratio);
+        auto [lazy_time, lazy_sum] = mixed_workload(deferred, points, writes, ratio);
+        if (eager_sum != lazy_sum) {
+            std::cerr << "maxima_bench: lazy maxima differ from eager" << std::endl;
+            return 1;
+        }
+        if (crossover == 0 && lazy_time < eager_time)
+            crossover = ratio;
+        std::cout << ratio << "  " << eager_time * 1e9 / writes << "  "
+                  << lazy_time * 1e9 / writes << "  " << lazy_time / eager_time << std::endl;
+    }
+    if (crossover != 0)
+        std::cout << "lazy wins from " << crossover << " writes per read" << std::endl;
+    else
+        std::cout << "eager wins at every tested ratio" << std::endl;
+    return 0;
+}
+
+// Czy punkt a jest lokalnym maksimum funkcji bez tolerancji.
+bool is_local_max(FunctionMaxima<std::int64_t, double> const& f, std::int64_t a) {
+    auto it = f.find(a);
+    if (it == f.end())
+        return false;
+    if (it != f.begin() && it->value() < std::prev(it)->value())
+        return false;
+    return std::next(it) == f.end() || !(it->value() < std::next(it)->value());
+}
+
+int jitter(int argc, char* argv[]) {
+    std::int64_t points = argc > 2 ? std::atoll(argv[2]) : 100000;
+    long writes = argc > 3 ? std::atol(argv[3]) : 1000000;
+    double eps = argc > 4 ? std::atof(argv[4]) : 2.0;
+    if (points <= 0 || writes <= 0 || !(eps >= 0)) {
+        std::cerr << "usage: maxima_bench jitter [points] [writes] [eps]" << std::endl;
+        return 1;
+    }
+    // Sinusoida o okresie ~300 punktów i amplitudzie 100 z szumem +-1:
+    // prawdziwych maksimów jest około points / 300, a szum tworzy wokół
+    // nich i na zboczach mnóstwo fałszywych.
+    auto signal = [](std::int64_t i) {
+        return 100.0 * std::sin(static_cast<double>(i) / 50.0);
+    };
+    std::mt19937_64 rng(3);
+    std::uniform_real_distribution<double> noise(-1.0, 1.0);
+    std::vector<std::pair<std::int64_t, double>> updates;
+    updates.reserve(static_cast<std::size_t>(writes));
+    for (long i = 0; i < writes; ++i) {
+        auto a = static_cast<std::int64_t>(rng() % static_cast<std::uint64_t>(points));
+        updates.emplace_back(a, signal(a) + noise(rng));
+    }
+
+    FunctionMaxima<std::int64_t, double> exact;
+    TolerantFunctionMaxima<std::int64_t, double> tolerant({eps});
+    for (std::int64_t i = 0; i < points; ++i) {
+        double v = signal(i) + noise(rng);
+        exact.set_value(i, v);
+        tolerant.set_value(i, v);
+    }
+    std::size_t tolerant_start = tolerant.churn();
+
+    FunctionMaxima<std::int64_t, double> counted(exact);
+    auto start = clock_type::now();
+    for (auto const& [a, v] : updates)
+        exact.set_value(a, v);
+    double exact_time = seconds_since(start);
+    start = clock_type::now();
+    for (auto const& [a, v] : updates)
+        tolerant.set_value(a, v);
+    double tolerant_time = seconds_since(start);
+
+    // Wejścia do zbioru maksimów i wyjścia z niego zliczamy osobnym
+    // przebiegiem; dziedzina to 0..points-1, więc sąsiedzi a to a-1 i a+1.
+    std::size_t exact_churn = 0;
+    for (auto const& [a, v] : updates) {
+        bool before[3], after[3];
+        for (int d = 0; d < 3; ++d)
+            before[d] = is_local_max(counted, a + d - 1);
+        counted.set_value(a, v);
+        for (int d = 0; d < 3; ++d) {
+            after[d] = is_local_max(counted, a + d - 1);
+            exact_churn += before[d] != after[d];
+        }
+    }
+
+    std::cout << "mode      maxima  toggles/write  ns/write" << std::endl;
+    std::cout << "exact     " << exact.mx_size() << "  "
+              << static_cast<double>(exact_churn) / static_cast<double>(writes) << "  "
+              << exact_time * 1e9 / static_cast<double>(writes) << std::endl;
+    std::cout << "eps=" << eps << "  " << tolerant.mx_size() << "  "
+              << static_cast<double>(tolerant.churn() - tolerant_start) / static_cast<double>(writes)
+              << "  " << tolerant_time * 1e9 / static_cast<double>(writes) << std::endl;
+    return 0;
+}
+
+int compressed(int argc, char* argv[]) {
+    std::int64_t points = argc > 2 ? std::atoll(argv[2]) : 10000000;
+    if (points <= 0) {
+        std::cerr << "usage: maxima_bench compressed [points]" << std::endl;
+        return 1;
+    }
+    // Znaczniki czasu co 1-3 s i odczyt czujnika błądzący o +-3 na krok.
+    std::mt19937_64 rng(5);
+    CompressedFunctionMaxima<std::int64_t, std::int32_t> c;
+    std::int64_t t = 1600000000;
+    std::int32_t v = 0;
+    auto start = clock_type::now();
+    for (std::int64_t i = 0; i < points; ++i) {
+        t += 1 + static_cast<std::int64_t>(rng() % 3);
+        v += static_cast<std::int32_t>(rng() % 7) - 3;
+        c.append(t, v);
+    }
+    double build = seconds_since(start);
+    c.shrink_to_fit();
+    std::cout << "points " << c.size() << ", " << static_cast<double>(c.memory_bytes()) / points
+              << " bytes/point, append " << build * 1e9 / points << " ns/point" << std::endl;
+
+    start = clock_type::now();
+    std::int64_t sum = 0;
+    for (auto const& p : c)
+        sum += p.value();
+    double scan = seconds_since(start);
+    std::cout << "scan " << scan * 1e9 / points << " ns/point (checksum " << sum << ")" << std::endl;
+
+    long lookups = 1000000;
+    start = clock_type::now();
+    long hits = 0;
+    for (long i = 0; i < lookups; ++i) {
+        std::int64_t a = 1600000000 + static_cast<std::int64_t>(rng() % (2 * points));
+        hits += c.find(a) != c.end();
+    }
+    double find = seconds_since(start);
+    std::cout << "find " << find * 1e9 / lookups << " ns (" << hits << " hits)" << std::endl;
+
+    start = clock_type::now();
+    std::size_t all = 0;
+    c.for_each_maximum([&](auto const&) { ++all; });
+    double all_time = seconds_since(start);
+    std::int32_t top = c.mx_top()->value();
+    std::cout << "maxima " << all << " in " << all_time << " s, top " << top << std::endl;
+    for (std::int32_t below : {1000, 100, 10}) {
+        std::size_t n = 0;
+        start = clock_type::now();
+        c.for_each_maximum_at_least(top - below, [&](auto const&) { ++n; });
+        std::cout << "maxima >= top-" << below << ": " << n << " in " << seconds_since(start)
+                  << " s" << std::endl;
+    }
+    return 0;
+}
+
+int checkpoint(int argc, char* argv[]) {
+    std::int64_t points = argc > 2 ? std::atoll(argv[2]) : 1000000;
+    long changes = argc > 3 ? std::atol(argv[3]) : 10000;
+    if (points <= 0 || changes < 0) {
+        std::cerr << "usage: maxima_bench checkpoint [points] [changes]" << std::endl;
+        return 1;
+    }
+    namespace fs = std::filesystem;
+    fs::path dir = fs::temp_directory_path() / ("maxima_bench_checkpoint_" + std::to_string(::getpid()));
+    fs::remove_all(dir);
+    std::mt19937_64 rng(11);
+    {
+        CheckpointedFunctionMaxima<std::int64_t, std::int64_t> c(dir.string());
+        for (std::int64_t i = 0; i < points; ++i)
+            c.set_value(i, static_cast<std::int64_t>(rng() % 1000000));
+        auto start = clock_type::now();
+        c.checkpoint();
+        std::cout << "first checkpoint (all " << points << " points): " << seconds_since(start)
+                  << " s" << std::endl;
+
+        for (long i = 0; i < changes; ++i)
+            c.set_value(static_cast<std::int64_t>(rng() % static_cast<std::uint64_t>(points)),
+                        static_cast<std::int64_t>(rng() % 1000000));
+        start = clock_type::now();
+        c.checkpoint();
+        std::cout << "delta checkpoint (" << changes << " changes): " << seconds_since(start)
+                  << " s" << std::endl;
+
+        start = clock_type::now();
+        c.compact();
+        double started = seconds_since(start);
+        c.wait_compaction();
+        std::cout << "compaction: " << started << " s in caller, " << seconds_since(start)
+                  << " s in background" << std::endl;
+    }
+    auto start = clock_type::now();
+    auto f = CheckpointedFunctionMaxima<std::int64_t, std::int64_t>::restore(dir.string());
+    double restore = seconds_since(start);
+    start = clock_type::now();
+    FunctionMaxima<std::int64_t, std::int64_t> replayed;
+    for (auto const& p : f)
+        replayed.set_value(p.arg(), p.value());
+    std::cout << "restore: " << restore << " s (" << f.size() << " points, " << f.mx_size()
+              << " maxima); set_value replay: " << seconds_since(start) << " s" << std::endl;
+    fs::remove_all(dir);
+    return 0;
+}
+
+int latency(int argc, char* argv[]) {
+    std::int64_t points = argc > 2 ? std::atoll(argv[2]) : 1000000;
+    long operations = argc > 3 ? std::atol(argv[3]) : 2000000;
+    if (points <= 0 || operations <= 0) {
+        std::cerr << "usage: maxima_bench latency [points] [operations]" << std::endl;
+        return 1;
+    }
+    std::mt19937_64 rng(13);
+    auto key = [&] { return static_cast<std::int64_t>(rng() % static_cast<std::uint64_t>(2 * points)); };
+    function f;
+    for (std::int64_t i = 0; i < points; ++i)
+        f.set_value(key(), static_cast<std::int64_t>(rng() % 1000));
+#ifdef MAKSIMA_LATENCY_HISTOGRAMS
+    f.reset_latencies();
+#endif
+
+    // 40% set_value, 20% erase, 40% find, argumenty z dwa razy większego
+    // przedziału niż liczba punktów - rozmiar funkcji pozostaje stabilny.
+    std::int64_t found = 0;
+    auto start = clock_type::now();
+    for (long i = 0; i < operations; ++i) {
+        std::uint64_t kind = rng() % 5;
+        if (kind < 2)
+            f.set_value(key(), static_cast<std::int64_t>(rng() % 1000));
+        else if (kind == 2)
+            f.erase(key());
+        else
+            found += f.find(key()) != f.end();
+    }
+    double seconds = seconds_since(start);
+    std::cout << operations << " operations: " << seconds * 1e9 / static_cast<double>(operations)
+              << " ns/op (size " << f.size() << ", " << found << " found)" << std::endl;
+#ifdef MAKSIMA_LATENCY_HISTOGRAMS
+    f.latencies().dump(std::cout);
+#else
+    std::cout << "build with -DMAKSIMA_LATENCY_HISTOGRAMS=ON for per-operation percentiles"
+              << std::endl;
+#endif
+    return 0;
+}
+
+int counters(int argc, char* argv[]) {
+    std::int64_t points = argc > 2 ? std::atoll(argv[2]) : 1000000;
+    if (points <= 0) {
+        std::cerr << "usage: maxima_bench counters [points]" << std::endl;
+        return 1;
+    }
+    maxima_perf::counters perf;
+    if (!perf.available())
+        std::cout << "perf_event_open unavailable (see /proc/sys/kernel/perf_event_paranoid);"
+                  << " reporting wall time only" << std::endl;
+    std::cout << std::left << std::setw(22) << "operation" << std::right << std::setw(10) << "ns";
+    for (char const* name : maxima_perf::event_names)
+        std::cout << std::setw(14) << name;
+    std::cout << "   (per operation)" << std::endl;
+
+    // Mierzy paczkę operacji batch() i wypisuje wartości na jedną operację.
+    auto measure = [&](char const* name, std::int64_t operations, auto&& batch) {
+        auto start = clock_type::now();
+        perf.start();
+        batch();
+        maxima_perf::readings r = perf.stop();
+        double seconds = seconds_since(start);
+        double n = static_cast<double>(std::max<std::int64_t>(operations, 1));
+        std::cout << std::left << std::setw(22) << name << std::right << std::fixed
+                  << std::setprecision(1) << std::setw(10) << seconds * 1e9 / n;
+        for (auto const& value : r) {
+            if (value)
+                std::cout << std::setw(14) << *value / n;
+            else
+                std::cout << std::setw(14) << "-";
+        }
+        std::cout << std::defaultfloat << std::endl;
+    };
+
+    std::mt19937_64 rng(17);
+    std::vector<std::int64_t> keys(static_cast<std::size_t>(points));
+    for (std::int64_t i = 0; i < points; ++i)
+        keys[static_cast<std::size_t>(i)] = i;
+    std::shuffle(keys.begin(), keys.end(), rng);
+    std::vector<std::int64_t> values(keys.size());
+    for (auto& v : values)
+        v = static_cast<std::int64_t>(rng() % 1000);
+
+    function f;
+    measure("set_value (new)", points, [&] {
+        for (std::size_t i = 0; i < keys.size(); ++i)
+            f.set_value(keys[i], values[i]);
+    });
+    std::shuffle(keys.begin(), keys.end(), rng);
+    measure("set_value (existing)", points, [&] {
+        for (std::size_t i = 0; i < keys.size(); ++i)
+            f.set_value(keys[i], values[i]);
+    });
+    std::shuffle(keys.begin(), keys.end(), rng);
+    std::int64_t sum = 0;
+    measure("find", points, [&] {
+        for (std::int64_t a : keys)
+            sum += f.find(a)->value();
+    });
+    measure("iterate", points, [&] {
+        for (auto const& p : f)
+            sum += p.value();
+    });
+    measure("iterate maxima", static_cast<std::int64_t>(f.mx_size()), [&] {
+        for (auto it = f.mx_begin(); it != f.mx_end(); ++it)
+            sum += it->value();
+    });
+    measure("copy (per point)", points, [&] {
+        function copy(f);
+        sum += static_cast<std::int64_t>(copy.size());
+    });
+    measure("erase", points, [&] {
+        for (std::int64_t a : keys)
+            f.erase(a);
+    });
+    std::cout << "checksum " << sum << std::endl;
+    return 0;
+}
+
+int allocations(int argc, char* argv[]) {
+    std::int64_t points = argc > 2 ? std::atoll(argv[2]) : 100000;
+    if (points <= 0) {
+        std::cerr << "usage: maxima_bench allocations [points]" << std::endl;
+        return 1;
+    }
+    std::cout << std::left << std::setw(22) << "operation" << std::right << std::setw(12)
+              << "allocs" << std::setw(12) << "bytes" << std::setw(12) << "frees"
+              << "   (per operation)" << std::endl;
+
+    // Alokacje paczki batch() na jedną operację.
+    auto measure = [&](char const* name, std::int64_t operations, auto&& batch) {
+        std::uint64_t count = allocation_count.load(std::memory_order_relaxed);
+        std::uint64_t bytes = allocated_bytes.load(std::memory_order_relaxed);
+        std::uint64_t frees = deallocation_count.load(std::memory_order_relaxed);
+        batch();
+        double n = static_cast<double>(std::max<std::int64_t>(operations, 1));
+        auto per_op = [n](std::uint64_t after, std::uint64_t before) {
+            return static_cast<double>(after - before) / n;
+        };
+        std::cout << std::left << std::setw(22) << name << std::right << std::fixed
+                  << std::setprecision(2)
+                  << std::setw(12) << per_op(allocation_count.load(std::memory_order_relaxed), count)
+                  << std::setw(12) << per_op(allocated_bytes.load(std::memory_order_relaxed), bytes)
+                  << std::setw(12) << per_op(deallocation_count.load(std::memory_order_relaxed), frees)
+                  << std::defaultfloat << std::endl;
+    };
+
+    // Wartości z małego zbioru, jak w typowych danych: większość set_value
+    // korzysta z już przechowywanej wartości.
+    std::mt19937_64 rng(19);
+    std::vector<std::int64_t> keys(static_cast<std::size_t>(points));
+    for (std::int64_t i = 0; i < points; ++i)
+        keys[static_cast<std::size_t>(i)] = i;
+    std::shuffle(keys.begin(), keys.end(), rng);
+    std::vector<std::int64_t> values(keys.size());
+    for (auto& v : values)
+        v = static_cast<std::int64_t>(rng() % 1000);
+
+    function f;
+    measure("set_value (new)", points, [&] {
+        for (std::size_t i = 0; i < keys.size(); ++i)
+            f.set_value(keys[i], values[i]);
+    });
+    std::shuffle(values.begin(), values.end(), rng);
+    measure("set_value (existing)", points, [&] {
+        for (std::size_t i = 0; i < keys.size(); ++i)
+            f.set_value(keys[i], values[i]);
+    });
+    measure("set_value (unique v)", points, [&] {
+        for (std::size_t i = 0; i < keys.size(); ++i)
+            f.set_value(keys[i], 1000 + static_cast<std::int64_t>(i));
+    });
+    std::int64_t sum = 0;
+    measure("find", points, [&] {
+        for (std::int64_t a : keys)
+            sum += f.find(a)->value();
+    });
+    measure("iterate", points, [&] {
+        for (auto const& p : f)
+            sum += p.value();
+    });
+    measure("iterate maxima", static_cast<std::int64_t>(f.mx_size()), [&] {
+        for (auto it = f.mx_begin(); it != f.mx_end(); ++it)
+            sum += it->value();
+    });
+    measure("copy (per point)", points, [&] {
+        function copy(f);
+        sum += static_cast<std::int64_t>(copy.size());
+    });
+    measure("erase", points, [&] {
+        for (std::int64_t a : keys)
+            f.erase(a);
+    });
+    std::cout << "checksum " << sum << std::endl;
+    return 0;
+}
+
+// Wartość, której operator< zgłasza wyjątek z prawdopodobieństwem
+// flaky_threshold / 2^64 (jak dziesiętne liczby ze sprawdzaniem nadmiaru).
+struct flaky_failure : std::exception {};
+
+std::uint64_t flaky_threshold = 0;
+std::uint64_t flaky_state = 1;
+
+struct flaky {
+    std::int64_t x;
+
+    friend bool operator<(flaky a, flaky b) {
+        // xorshift64*
+        flaky_state ^= flaky_state >> 12;
+        flaky_state ^= flaky_state << 25;
+        flaky_state ^= flaky_state >> 27;
+        if (flaky_state * 0x2545f4914f6cdd1d < flaky_threshold)
+            throw flaky_failure();
+        return a.x < b.x;
+    }
+};
+
+[[gnu::noinline]] void throw_flaky() {
+    throw flaky_failure();
+}
+
+int rollback(int argc, char* argv[]) {
+    std::int64_t max_points = argc > 2 ? std::atoll(argv[2]) : 100000;
+    long operations = argc > 3 ? std::atol(argv[3]) : 200000;
+    double probability = argc > 4 ? std::atof(argv[4]) : 0.01;
+    if (max_points < 1000 || operations <= 0 || probability < 0 || probability >= 1) {
+        std::cerr << "usage: maxima_bench rollback [max points >= 1000] [operations] [probability]"
+                  << std::endl;
+        return 1;
+    }
+
+    // Sam wyjątek (zgłoszenie i złapanie jednej ramki niżej), bez wycofywania.
+    long const throws = 100000;
+    auto start = clock_type::now();
+    for (long i = 0; i < throws; ++i) {
+        try {
+            throw_flaky();
+        } catch (flaky_failure const&) {
+        }
+    }
+    std::cout << "throw + catch alone: " << seconds_since(start) * 1e9 / throws << " ns" << std::endl;
+    std::cout << "probability " << probability << " per comparison; ns per operation"
+              << " (ns / log2 n in parentheses)" << std::endl;
+    std::cout << std::setw(10) << "points" << std::setw(22) << "set_value ok"
+              << std::setw(22) << "set_value failed" << std::setw(22) << "erase ok"
+              << std::setw(22) << "erase failed" << std::setw(10) << "failed" << std::endl;
+
+    using flaky_function = FunctionMaxima<flaky, flaky>;
+    for (std::int64_t n = 1000; n <= max_points; n *= 10) {
+        flaky_threshold = 0;
+        std::mt19937_64 rng(static_cast<std::uint64_t>(n));
+        std::vector<std::pair<flaky, flaky>> batch;
+        for (std::int64_t i = 0; i < n; ++i)
+            batch.emplace_back(flaky{2 * i}, flaky{static_cast<std::int64_t>(rng() % 1000)});
+        flaky_function f;
+        f.apply_batch(std::move(batch));
+
+        // Po równo set_value i erase na argumentach z [0, 2n) - rozmiar
+        // funkcji pozostaje blisko n. [operacja][czy przerwana]
+        double time[2][2] = {};
+        long count[2][2] = {};
+        flaky_threshold = static_cast<std::uint64_t>(probability * 18446744073709551616.0);
+        for (long i = 0; i < operations; ++i) {
+            int erase = static_cast<int>(rng() & 1);
+            flaky a{static_cast<std::int64_t>(rng() % static_cast<std::uint64_t>(2 * n))};
+            flaky v{static_cast<std::int64_t>(rng() % 1000)};
+            int failed = 0;
+            auto op_start = clock_type::now();
+            try {
+                if (erase)
+                    f.erase(a);
+                else
+                    f.set_value(a, v);
+            } catch (flaky_failure const&) {
+                failed = 1;
+            }
+            time[erase][failed] += seconds_since(op_start);
+            ++count[erase][failed];
+        }
+        flaky_threshold = 0;
+
+        double log_n = std::log2(static_cast<double>(n));
+        std::cout << std::setw(10) << n << std::fixed << std::setprecision(1);
+        for (int erase = 0; erase < 2; ++erase) {
+            for (int failed = 0; failed < 2; ++failed) {
+                double ns = count[erase][failed] > 0 ? time[erase][failed] * 1e9 / count[erase][failed] : 0;
+                std::ostringstream cell;
+                cell << std::fixed << std::setprecision(1) << ns << " (" << ns / log_n << ")";
+                std::cout << std::setw(22) << cell.str();
+            }
+        }
+        long failed = count[0][1] + count[1][1];
+        std::cout << std::setw(9) << 100.0 * static_cast<double>(failed) / static_cast<double>(operations)
+                  << '%' << std::defaultfloat << std::endl;
+    }
+    return 0;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    std::string command = argc > 1 ? argv[1] : "";
+    if (command == "reduce")
+        return reduce(argc, argv);
+    if (command == "lazy")
+        return lazy(argc, argv);
+    if (command == "jitter")
+        return jitter(argc, argv);
+    if (command == "compressed")
+        return compressed(argc, argv);
+    if (command == "checkpoint")
+        return checkpoint(argc, argv);
+    if (command == "latency")
+        return latency(argc, argv);
+    if (command == "counters")
+        return counters(argc, argv);
+    if (command == "allocations")
+        return allocations(argc, argv);
+    if (command == "rollback")
+        return rollback(argc, argv);
+    std::cerr << "usage: maxima_bench reduce [maxima] [max threads]\n"
+              << "       maxima_bench lazy [points] [writes]\n"
+              << "       maxima_bench jitter [points] [writes] [eps]\n"
+              << "       maxima_bench compressed [points]\n"
+              << "       maxima_bench checkpoint [points] [changes]\n"
+              << "       maxima_bench latency [points] [operations]\n"
+              << "       maxima_bench counters [points]\n"
+              << "       maxima_bench allocations [points]\n"
+              << "       maxima_bench rollback [max points] [operations] [probability]" << std::endl;
+    return 1;
+}
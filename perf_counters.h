@@ -0,0 +1,119 @@
+#ifndef MAKSIMA_PERF_COUNTERS_H
+#define MAKSIMA_PERF_COUNTERS_H
+
+// Liczniki sprzętowe Linuksa (perf_event_open) dla pomiarów w maxima_bench:
+// cykle, instrukcje, chybienia L1D i LLC przy odczycie oraz błędnie
+// przewidziane skoki, liczone tylko w przestrzeni użytkownika dla wątku
+// wołającego. Każdy licznik otwieramy osobno, więc brak jednego (np.
+// w maszynie wirtualnej bez LLC) nie wyłącza pozostałych; gdy jądro nie
+// pozwala na żaden (perf_event_paranoid, kontener, inny system), available()
+// zwraca false, a pomiary zwracają same puste wartości. Gdy jądro
+// multipleksuje liczniki, wynik jest skalowany czasem, w którym licznik
+// faktycznie liczył.
+
+#include <array>
+#include <cstdint>
+#include <optional>
+#include <utility>
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace maxima_perf {
+
+inline constexpr std::size_t event_count = 5;
+
+inline constexpr std::array<char const*, event_count> event_names = {
+        "cycles", "instructions", "L1d-miss", "LLC-miss", "br-miss"};
+
+using readings = std::array<std::optional<double>, event_count>;
+
+class counters {
+public:
+    counters() noexcept {
+#if defined(__linux__)
+        constexpr std::uint64_t read_miss = (PERF_COUNT_HW_CACHE_OP_READ << 8)
+                | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+        std::array<std::pair<std::uint32_t, std::uint64_t>, event_count> events = {{
+                {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+                {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+                {PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D | read_miss},
+                {PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_LL | read_miss},
+                {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+        }};
+        for (std::size_t i = 0; i < event_count; ++i) {
+            perf_event_attr attr{};
+            attr.size = sizeof attr;
+            attr.type = events[i].first;
+            attr.config = events[i].second;
+            attr.disabled = 1;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+            fds[i] = static_cast<int>(::syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+        }
+#endif
+    }
+
+    counters(counters const&) = delete;
+    counters& operator=(counters const&) = delete;
+
+    ~counters() {
+#if defined(__linux__)
+        for (int fd : fds) {
+            if (fd >= 0)
+                ::close(fd);
+        }
+#endif
+    }
+
+    // Czy działa choć jeden licznik.
+    bool available() const noexcept {
+        for (int fd : fds) {
+            if (fd >= 0)
+                return true;
+        }
+        return false;
+    }
+
+    void start() noexcept {
+#if defined(__linux__)
+        for (int fd : fds) {
+            if (fd >= 0) {
+                ::ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+                ::ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+            }
+        }
+#endif
+    }
+
+    // Wartości liczników od start(); brak wartości dla liczników, które nie
+    // działają albo nie zdążyły nic zmierzyć.
+    readings stop() noexcept {
+        readings r;
+#if defined(__linux__)
+        for (std::size_t i = 0; i < event_count; ++i) {
+            if (fds[i] < 0)
+                continue;
+            ::ioctl(fds[i], PERF_EVENT_IOC_DISABLE, 0);
+            std::uint64_t data[3];  // wartość, czas włączenia, czas liczenia
+            if (::read(fds[i], data, sizeof data) != static_cast<ssize_t>(sizeof data) || data[2] == 0)
+                continue;
+            r[i] = static_cast<double>(data[0]) * static_cast<double>(data[1])
+                    / static_cast<double>(data[2]);
+        }
+#endif
+        return r;
+    }
+
+private:
+    std::array<int, event_count> fds = {-1, -1, -1, -1, -1};
+};
+
+} // namespace maxima_perf
+
+#endif //MAKSIMA_PERF_COUNTERS_H
@@ -0,0 +1,247 @@
+#ifndef MAKSIMA_TOLERANT_FUNCTION_MAXIMA_H
+#define MAKSIMA_TOLERANT_FUNCTION_MAXIMA_H
+
+#include "function_maxima.h"
+
+#include <cstddef>
+#include <iterator>
+#include <memory>
+#include <utility>
+
+// Domyślna tolerancja: sąsiad pokonuje punkt, gdy jego wartość przewyższa
+// wartość punktu o więcej niż eps. Wymaga V + V.
+template <typename V>
+struct absolute_tolerance {
+    V eps{};
+
+    bool beaten(V const& v, V const& neighbor) const {
+        return v + eps < neighbor;
+    }
+};
+
+// FunctionMaxima z histerezą w zbiorze maksimów, tłumiąca szum w danych.
+// Punkt wchodzi do zbioru maksimów jak w FunctionMaxima - gdy żaden sąsiad
+// nie jest od niego większy - ale pozostaje w nim, dopóki żaden sąsiad go
+// nie pokona według polityki Tolerance (dla absolute_tolerance: o więcej
+// niż eps). Wahania w granicach tolerancji nie wstawiają więc ani nie usuwają
+// maksimów. Status punktu zależy od historii; zawsze zachodzi jednak:
+//  - punkt w zbiorze maksimów nie jest pokonany przez żadnego sąsiada,
+//  - punkt spoza zbioru ma sąsiada większego od siebie.
+// Dla eps = 0 zbiór maksimów jest taki sam jak w FunctionMaxima. Operacje
+// mają te same złożoności i silną gwarancję co w FunctionMaxima.
+template <typename A, typename V, typename Tolerance = absolute_tolerance<V>>
+class TolerantFunctionMaxima {
+public:
+    using function_type = FunctionMaxima<A, V>;
+    using point_type = typename function_type::point_type;
+    using iterator = typename function_type::iterator;
+    using mx_iterator = typename function_type::mx_iterator;
+    using size_type = typename function_type::size_type;
+
+    TolerantFunctionMaxima() = default;
+
+    explicit TolerantFunctionMaxima(Tolerance tolerance) : tol(std::move(tolerance)) {}
+
+    iterator begin() const noexcept {
+        return f.begin();
+    }
+
+    iterator end() const noexcept {
+        return f.end();
+    }
+
+    iterator find(A const& a) const {
+        return f.find(a);
+    }
+
+    V const& value_at(A const& a) const {
+        return f.value_at(a);
+    }
+
+    size_type size() const noexcept {
+        return f.size();
+    }
+
+    mx_iterator mx_begin() const noexcept {
+        return mx.cbegin();
+    }
+
+    mx_iterator mx_end() const noexcept {
+        return mx.cend();
+    }
+
+    size_type mx_size() const noexcept {
+        return mx.size();
+    }
+
+    void set_value(A const& a, V const& v);
+    void erase(A const& a);
+
+    // Liczba wejść punktów do zbioru maksimów i wyjść z niego od utworzenia
+    // obiektu (wymiana wpisu maksimum, które zmieniło wartość i nim
+    // pozostało, się nie liczy).
+    std::size_t churn() const noexcept {
+        return changes;
+    }
+
+    Tolerance const& tolerance() const noexcept {
+        return tol;
+    }
+
+private:
+    using rg_iterator = typename function_type::rg_iterator;
+    using maxima_set = typename function_type::maxima_set;
+
+    // Używamy tylko dziedziny i zbioru wartości f; f.maxima pozostaje puste.
+    function_type f;
+    maxima_set mx;
+    Tolerance tol;
+    std::size_t changes = 0;
+
+    // Czy punkt o wartości v i sąsiadach o wartościach *left, *right (nullptr
+    // - brak sąsiada) jest maksimum, jeśli był nim (was) przed zmianą.
+    bool keeps(V const& v, V const* left, V const* right, bool was) const {
+        auto beats = [&](V const* neighbor) {
+            return neighbor != nullptr && (was ? tol.beaten(v, *neighbor) : v < *neighbor);
+        };
+        return !beats(left) && !beats(right);
+    }
+
+    V const* value_before(iterator it) const noexcept {
+        return it == f.begin() ? nullptr : &std::prev(it)->value();
+    }
+
+    V const* value_after(iterator it) const noexcept {
+        return std::next(it) == f.end() ? nullptr : &std::next(it)->value();
+    }
+
+    // Usuwa z mx wpis, jeśli jest i punkt przestał być maksimum.
+    void drop(mx_iterator entry, bool keep) noexcept {
+        if (entry != mx.end() && !keep) {
+            mx.erase(entry);
+            ++changes;
+        }
+    }
+
+    // Zlicza wejście do zbioru maksimów, jeśli wpis został dodany.
+    void count_entry(mx_iterator inserted) noexcept {
+        if (inserted != mx.end())
+            ++changes;
+    }
+};
+
+template <typename A, typename V, typename Tolerance>
+void TolerantFunctionMaxima<A, V, Tolerance>::set_value(A const& a, V const& v) {
+    // Najpierw wszystkie porównania (mogą zgłosić wyjątek), bez modyfikacji.
+    iterator right = f.fun.lower_bound(a);
+    bool found = right != f.end() && !(a < right->arg());
+    iterator it = found ? right : f.end();
+    if (found) {
+        if (!(it->value() < v) && !(v < it->value()))
+            return;
+        ++right;
+    }
+    iterator pos = found ? it : right;
+    iterator left = pos == f.begin() ? f.end() : std::prev(pos);
+    bool left_exist = left != f.end();
+    bool right_exist = right != f.end();
+    rg_iterator v_old = found ? f.rg_find(it->value()) : f.rg_end();
+
+    mx_iterator it_mx = found ? mx.find(*it) : mx.end();
+    mx_iterator left_mx = left_exist ? mx.find(*left) : mx.end();
+    mx_iterator right_mx = right_exist ? mx.find(*right) : mx.end();
+    bool will_be_max = keeps(v, left_exist ? &left->value() : nullptr,
+                             right_exist ? &right->value() : nullptr, it_mx != mx.end());
+    bool will_be_max_l = left_exist
+            && keeps(left->value(), value_before(left), &v, left_mx != mx.end());
+    bool will_be_max_r = right_exist
+            && keeps(right->value(), &v, value_after(right), right_mx != mx.end());
+
+    std::shared_ptr<A> a_ptr = found ? it->arg_ptr : std::make_shared<A>(a);
+    auto [v_new, v_inserted] = f.intern(v);
+    iterator inserted = f.end();
+    mx_iterator new_mx = mx.end(), new_mx_l = mx.end(), new_mx_r = mx.end();
+    try {
+        if (!found)
+            inserted = f.fun.insert_before(right, point_type{a_ptr, v_new->ptr});
+        if (will_be_max)
+            new_mx = mx.insert(point_type{a_ptr, v_new->ptr}).first;
+        if (will_be_max_l && left_mx == mx.end())
+            new_mx_l = mx.insert(*left).first;
+        if (will_be_max_r && right_mx == mx.end())
+            new_mx_r = mx.insert(*right).first;
+    } catch (...) {
+        for (mx_iterator e : {new_mx, new_mx_l, new_mx_r}) {
+            if (e != mx.end())
+                mx.erase(e);
+        }
+        if (inserted != f.end())
+            f.fun.erase(inserted);
+        if (v_inserted)
+            f.range.erase(v_new);
+        throw;
+    }
+
+    // Zatwierdzenie - już tylko operacje noexcept.
+    if (it_mx == mx.end())
+        count_entry(new_mx);
+    count_entry(new_mx_l);
+    count_entry(new_mx_r);
+    if (it_mx != mx.end()) {
+        mx.erase(it_mx);
+        changes += !will_be_max;
+    }
+    drop(left_mx, will_be_max_l);
+    drop(right_mx, will_be_max_r);
+    ++v_new->users;
+    if (found) {
+        it->replace_value(v_new->ptr);
+        f.release(v_old);
+    }
+}
+
+template <typename A, typename V, typename Tolerance>
+void TolerantFunctionMaxima<A, V, Tolerance>::erase(A const& a) {
+    iterator it = f.find(a);
+    if (it == f.end())
+        return;
+    iterator left = it == f.begin() ? f.end() : std::prev(it);
+    iterator right = std::next(it);
+    bool left_exist = left != f.end();
+    bool right_exist = right != f.end();
+
+    mx_iterator it_mx = mx.find(*it);
+    mx_iterator left_mx = left_exist ? mx.find(*left) : mx.end();
+    mx_iterator right_mx = right_exist ? mx.find(*right) : mx.end();
+    bool will_be_max_l = left_exist
+            && keeps(left->value(), value_before(left),
+                     right_exist ? &right->value() : nullptr, left_mx != mx.end());
+    bool will_be_max_r = right_exist
+            && keeps(right->value(), left_exist ? &left->value() : nullptr,
+                     value_after(right), right_mx != mx.end());
+    rg_iterator rg_it = f.rg_find(it->value());
+
+    mx_iterator new_mx_l = mx.end(), new_mx_r = mx.end();
+    if (will_be_max_l && left_mx == mx.end())
+        new_mx_l = mx.insert(*left).first;
+    if (will_be_max_r && right_mx == mx.end()) {
+        try {
+            new_mx_r = mx.insert(*right).first;
+        } catch (...) {
+            if (new_mx_l != mx.end())
+                mx.erase(new_mx_l);
+            throw;
+        }
+    }
+
+    // Zatwierdzenie - już tylko operacje noexcept.
+    count_entry(new_mx_l);
+    count_entry(new_mx_r);
+    drop(it_mx, false);
+    drop(left_mx, will_be_max_l);
+    drop(right_mx, will_be_max_r);
+    f.fun.erase(it);
+    f.release(rg_it);
+}
+
+#endif //MAKSIMA_TOLERANT_FUNCTION_MAXIMA_H
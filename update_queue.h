@@ -0,0 +1,290 @@
+#ifndef MAKSIMA_UPDATE_QUEUE_H
+#define MAKSIMA_UPDATE_QUEUE_H
+
+// Kolejka aktualizacji przed FunctionMaxima dla wielu wątków-producentów.
+// submit() i submit_erase() wstawiają węzeł do nieblokującej kolejki MPSC
+// (wariant Vyukova: jedna wymiana wskaźnika na producenta, bez CAS w pętli)
+// i wracają od razu. Jeden wątek aplikujący zdejmuje z kolejki wszystko, co
+// w niej jest, zostawia dla każdego argumentu tylko ostatnią aktualizację i
+// wykonuje set_value / erase na paczce pod muteksem funkcji. Odczyty
+// (read) biorą ten sam muteks, więc widzą funkcję między paczkami.
+
+#include "function_maxima.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <utility>
+
+struct update_queue_stats {
+    std::uint64_t submitted = 0;
+    std::uint64_t applied = 0;    // wywołania set_value / erase
+    std::uint64_t coalesced = 0;  // aktualizacje zastąpione późniejszymi
+    std::uint64_t failed = 0;     // aktualizacje, które rzuciły wyjątek
+    std::uint64_t batches = 0;
+    std::size_t depth = 0;        // aktualizacje czekające w kolejce
+    std::size_t max_depth = 0;
+    // Czas od submit do zaaplikowania aktualizacji (lub jej zastąpienia).
+    std::chrono::nanoseconds mean_latency{0};
+    std::chrono::nanoseconds max_latency{0};
+};
+
+template <typename A, typename V>
+class UpdateQueue {
+public:
+    using function_type = FunctionMaxima<A, V>;
+
+    // max_batch ogranicza liczbę węzłów zdejmowanych na jedną paczkę, a więc
+    // i czas, przez który odczyty czekają na muteks funkcji.
+    explicit UpdateQueue(std::size_t max_batch = 65536)
+            : max_batch(max_batch == 0 ? 1 : max_batch), applier([this] { run(); }) {}
+
+    UpdateQueue(UpdateQueue const&) = delete;
+    UpdateQueue& operator=(UpdateQueue const&) = delete;
+
+    // Aplikuje wszystko, co zostało wysłane, i zatrzymuje wątek aplikujący.
+    ~UpdateQueue() {
+        stopping.store(true);
+        wake();
+        applier.join();
+    }
+
+    // Gwarancja silna: rzuca tylko przy alokacji węzła, zanim trafi on do
+    // kolejki.
+    void submit(A const& a, V const& v) {
+        push(new node(a, v));
+    }
+
+    void submit_erase(A const& a) {
+        push(new node(a, std::nullopt));
+    }
+
+    // Czeka, aż zostaną zaaplikowane wszystkie aktualizacje wysłane przed
+    // wywołaniem (przez dowolny wątek).
+    void flush() {
+        std::uint64_t target = submitted.load();
+        wake();
+        std::unique_lock<std::mutex> lock(done_mutex);
+        done_cv.wait(lock, [&] { return finished.load() >= target; });
+    }
+
+    // Wywołuje f(function_type const&) między paczkami aktualizacji.
+    template <typename F>
+    decltype(auto) read(F&& f) const {
+        std::lock_guard<std::mutex> lock(function_mutex);
+        return std::forward<F>(f)(fun);
+    }
+
+    update_queue_stats stats() const {
+        update_queue_stats s;
+        s.submitted = submitted.load(std::memory_order_relaxed);
+        s.applied = applied.load(std::memory_order_relaxed);
+        s.coalesced = coalesced.load(std::memory_order_relaxed);
+        s.failed = failed.load(std::memory_order_relaxed);
+        s.batches = batches.load(std::memory_order_relaxed);
+        s.depth = depth.load(std::memory_order_relaxed);
+        s.max_depth = max_depth.load(std::memory_order_relaxed);
+        std::uint64_t done = s.applied + s.coalesced + s.failed;
+        if (done > 0)
+            s.mean_latency = std::chrono::nanoseconds(
+                    latency_total.load(std::memory_order_relaxed) / done);
+        s.max_latency = std::chrono::nanoseconds(
+                latency_max.load(std::memory_order_relaxed));
+        return s;
+    }
+
+private:
+    using clock = std::chrono::steady_clock;
+
+    struct link_node {
+        std::atomic<link_node*> next{nullptr};
+    };
+
+    struct node : link_node {
+        A arg;
+        std::optional<V> value;  // brak wartości oznacza erase
+        clock::time_point submitted_at;
+
+        node(A const& a, std::optional<V> v)
+                : arg(a), value(std::move(v)), submitted_at(clock::now()) {}
+    };
+
+    // Wskaźniki kolejki Vyukova: producenci dopisują za head, konsument
+    // czyta od tail. stub pozwala odróżnić kolejkę pustą od jednoelementowej.
+    link_node stub;
+    alignas(64) std::atomic<link_node*> head{&stub};
+    alignas(64) link_node* tail = &stub;
+    std::size_t const max_batch;
+
+    alignas(64) std::atomic<std::size_t> depth{0};
+    std::atomic<std::size_t> max_depth{0};
+    std::atomic<std::uint64_t> submitted{0};
+    std::atomic<std::uint64_t> applied{0};
+    std::atomic<std::uint64_t> coalesced{0};
+    std::atomic<std::uint64_t> failed{0};
+    std::atomic<std::uint64_t> finished{0};
+    std::atomic<std::uint64_t> batches{0};
+    std::atomic<std::uint64_t> latency_total{0};
+    std::atomic<std::uint64_t> latency_max{0};
+
+    std::atomic<bool> stopping{false};
+    std::atomic<bool> sleeping{false};
+    std::mutex wake_mutex;
+    std::condition_variable wake_cv;
+    std::mutex done_mutex;
+    std::condition_variable done_cv;
+
+    mutable std::mutex function_mutex;
+    function_type fun;
+
+    std::thread applier;
+
+    void link(link_node* n) noexcept {
+        n->next.store(nullptr, std::memory_order_relaxed);
+        link_node* prev = head.exchange(n, std::memory_order_acq_rel);
+        prev->next.store(n, std::memory_order_release);
+    }
+
+    void push(node* n) noexcept {
+        std::size_t d = depth.fetch_add(1) + 1;
+        std::size_t m = max_depth.load(std::memory_order_relaxed);
+        while (d > m && !max_depth.compare_exchange_weak(m, d, std::memory_order_relaxed)) {}
+        submitted.fetch_add(1);
+        link(n);
+        if (sleeping.load())
+            wake();
+    }
+
+    void wake() {
+        std::lock_guard<std::mutex> lock(wake_mutex);
+        wake_cv.notify_one();
+    }
+
+    // Zdejmuje najstarszy węzeł albo zwraca nullptr, gdy kolejka jest pusta
+    // lub producent jest w trakcie dopinania węzła.
+    node* pop() noexcept {
+        link_node* t = tail;
+        link_node* next = t->next.load(std::memory_order_acquire);
+        if (t == &stub) {
+            if (next == nullptr)
+                return nullptr;
+            tail = next;
+            t = next;
+            next = next->next.load(std::memory_order_acquire);
+        }
+        if (next != nullptr) {
+            tail = next;
+            return static_cast<node*>(t);
+        }
+        if (t != head.load(std::memory_order_acquire))
+            return nullptr;
+        link(&stub);
+        next = t->next.load(std::memory_order_acquire);
+        if (next != nullptr) {
+            tail = next;
+            return static_cast<node*>(t);
+        }
+        return nullptr;
+    }
+
+    void record_latency(clock::time_point now, node const* n) noexcept {
+        auto ns = static_cast<std::uint64_t>(
+                std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        now - n->submitted_at).count());
+        latency_total.fetch_add(ns, std::memory_order_relaxed);
+        std::uint64_t m = latency_max.load(std::memory_order_relaxed);
+        while (ns > m && !latency_max.compare_exchange_weak(m, ns, std::memory_order_relaxed)) {}
+    }
+
+    void run() {
+        // Argumenty mają tylko operator<, więc paczkę scalamy w std::map.
+        std::map<A, node*> batch;
+        for (;;) {
+            node* n;
+            std::size_t taken = 0;
+            while (taken < max_batch && (n = pop()) != nullptr) {
+                ++taken;
+                depth.fetch_sub(1, std::memory_order_relaxed);
+                try {
+                    auto [it, inserted] = batch.try_emplace(n->arg, n);
+                    if (!inserted) {
+                        record_latency(clock::now(), it->second);
+                        delete it->second;
+                        coalesced.fetch_add(1, std::memory_order_relaxed);
+                        it->second = n;
+                    }
+                } catch (...) {
+                    // Porównanie argumentów albo alokacja w mapie rzuciły -
+                    // aktualizacja przepada tak jak nieudany set_value.
+                    record_latency(clock::now(), n);
+                    delete n;
+                    failed.fetch_add(1, std::memory_order_relaxed);
+                }
+            }
+            if (!batch.empty()) {
+                apply(batch);
+                continue;
+            }
+            if (taken > 0) {
+                // Wszystkie zdjęte aktualizacje przepadły przy scalaniu.
+                publish_finished();
+                continue;
+            }
+            if (depth.load() > 0) {
+                // Producent wymienił head, ale nie dopiął jeszcze next.
+                std::this_thread::yield();
+                continue;
+            }
+            if (stopping.load())
+                return;
+            std::unique_lock<std::mutex> lock(wake_mutex);
+            sleeping.store(true);
+            wake_cv.wait(lock, [&] { return depth.load() > 0 || stopping.load(); });
+            sleeping.store(false);
+        }
+    }
+
+    void apply(std::map<A, node*>& batch) {
+        {
+            std::lock_guard<std::mutex> lock(function_mutex);
+            for (auto const& [arg, n] : batch) {
+                try {
+                    if (n->value)
+                        fun.set_value(arg, *n->value);
+                    else
+                        fun.erase(arg);
+                    applied.fetch_add(1, std::memory_order_relaxed);
+                } catch (...) {
+                    // Funkcja pozostała bez zmian (gwarancja silna).
+                    failed.fetch_add(1, std::memory_order_relaxed);
+                }
+            }
+        }
+        clock::time_point now = clock::now();
+        for (auto const& entry : batch) {
+            record_latency(now, entry.second);
+            delete entry.second;
+        }
+        batches.fetch_add(1, std::memory_order_relaxed);
+        publish_finished();
+        batch.clear();
+    }
+
+    void publish_finished() {
+        {
+            std::lock_guard<std::mutex> lock(done_mutex);
+            // finished liczy też zastąpione i nieudane aktualizacje.
+            finished.store(applied.load() + coalesced.load() + failed.load());
+        }
+        done_cv.notify_all();
+    }
+};
+
+#endif //MAKSIMA_UPDATE_QUEUE_H
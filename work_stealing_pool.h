@@ -0,0 +1,216 @@
+#ifndef MAKSIMA_WORK_STEALING_POOL_H
+#define MAKSIMA_WORK_STEALING_POOL_H
+
+// Pula wątków z podkradaniem pracy dla FunctionMaxima::apply_parallel
+// (i każdego innego kodu, który potrzebuje parallel_for). Każdy wątek ma
+// własną kolejkę zakresów indeksów: zdejmuje z jej końca, a gdy jest pusta,
+// podkrada z początku kolejek innych wątków. Zakres większy niż jeden
+// indeks jest przed wykonaniem dzielony na pół - druga połowa trafia do
+// kolejki, skąd mogą ją zabrać bezczynne wątki. Wątek wołający
+// parallel_for również wykonuje zadania, dopóki pętla się nie skończy.
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+class WorkStealingPool {
+public:
+    // threads to liczba wątków pomocniczych; wątek wołający parallel_for
+    // pracuje razem z nimi.
+    explicit WorkStealingPool(unsigned threads = default_threads()) : queues(threads + 1) {
+        workers.reserve(threads);
+        try {
+            for (unsigned i = 0; i < threads; ++i)
+                workers.emplace_back([this, i] { work(i); });
+        } catch (...) {
+            stop();
+            throw;
+        }
+    }
+
+    WorkStealingPool(WorkStealingPool const&) = delete;
+    WorkStealingPool& operator=(WorkStealingPool const&) = delete;
+
+    ~WorkStealingPool() {
+        stop();
+    }
+
+    // Liczba wątków wykonujących zadania pętli, łącznie z wołającym.
+    std::size_t concurrency() const noexcept {
+        return workers.size() + 1;
+    }
+
+    // Wywołuje f(i) dla każdego i z [0, n) i czeka na zakończenie wszystkich
+    // wywołań. Po pierwszym wyjątku pozostałe indeksy są pomijane, a wyjątek
+    // jest zgłaszany ponownie w wątku wołającym. Wołanie parallel_for
+    // z wnętrza zadania jest dozwolone.
+    template <typename F>
+    void parallel_for(std::size_t n, F&& f) {
+        if (n == 0)
+            return;
+        loop l;
+        l.fn = &f;
+        l.call = [](void* fn, std::size_t i) {
+            (*static_cast<std::remove_reference_t<F>*>(fn))(i);
+        };
+        l.size = n;
+        std::size_t self = current_queue();
+        push(self, range{&l, 0, n});
+        while (l.done.load(std::memory_order_acquire) < n) {
+            range r;
+            if (pop(self, r) || steal(self, r))
+                run(self, r);
+            else
+                std::this_thread::yield();
+        }
+        if (l.error)
+            std::rethrow_exception(l.error);
+    }
+
+private:
+    struct loop {
+        void* fn = nullptr;
+        void (*call)(void*, std::size_t) = nullptr;
+        std::size_t size = 0;
+        std::atomic<std::size_t> done{0};
+        std::atomic<bool> failed{false};
+        std::mutex error_mutex;
+        std::exception_ptr error;
+    };
+
+    struct range {
+        loop* l = nullptr;
+        std::size_t first = 0, last = 0;
+    };
+
+    struct queue {
+        std::mutex m;
+        std::deque<range> ranges;
+    };
+
+    std::vector<queue> queues;  // ostatnia należy do wątków spoza puli
+    std::vector<std::thread> workers;
+    std::atomic<std::size_t> queued{0};
+    std::mutex sleep_mutex;
+    std::condition_variable sleep_cv;
+    bool stopping = false;
+
+    static unsigned default_threads() noexcept {
+        unsigned n = std::thread::hardware_concurrency();
+        return n > 1 ? n - 1 : 0;
+    }
+
+    // Pula i numer kolejki wątku pomocniczego, który wykonuje ten kod.
+    struct worker_slot {
+        WorkStealingPool const* pool = nullptr;
+        std::size_t index = 0;
+    };
+
+    static worker_slot& current_worker() noexcept {
+        static thread_local worker_slot slot;
+        return slot;
+    }
+
+    std::size_t current_queue() const noexcept {
+        worker_slot const& slot = current_worker();
+        return slot.pool == this ? slot.index : workers.size();
+    }
+
+    void stop() noexcept {
+        {
+            std::lock_guard<std::mutex> lock(sleep_mutex);
+            stopping = true;
+        }
+        sleep_cv.notify_all();
+        for (std::thread& w : workers)
+            w.join();
+        workers.clear();
+    }
+
+    void push(std::size_t q, range r) {
+        {
+            std::lock_guard<std::mutex> lock(queues[q].m);
+            queues[q].ranges.push_back(r);
+        }
+        queued.fetch_add(1);
+        std::lock_guard<std::mutex> lock(sleep_mutex);
+        sleep_cv.notify_one();
+    }
+
+    bool pop(std::size_t q, range& r) {
+        std::lock_guard<std::mutex> lock(queues[q].m);
+        if (queues[q].ranges.empty())
+            return false;
+        r = queues[q].ranges.back();
+        queues[q].ranges.pop_back();
+        queued.fetch_sub(1);
+        return true;
+    }
+
+    bool steal(std::size_t self, range& r) {
+        for (std::size_t k = 1; k < queues.size(); ++k) {
+            queue& victim = queues[(self + k) % queues.size()];
+            std::lock_guard<std::mutex> lock(victim.m);
+            if (!victim.ranges.empty()) {
+                r = victim.ranges.front();
+                victim.ranges.pop_front();
+                queued.fetch_sub(1);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void run(std::size_t self, range r) {
+        loop& l = *r.l;
+        while (r.last - r.first > 1) {
+            std::size_t mid = r.first + (r.last - r.first) / 2;
+            try {
+                push(self, range{&l, mid, r.last});
+                r.last = mid;
+            } catch (...) {
+                // Bez miejsca w kolejce wykonujemy cały zakres sami.
+                break;
+            }
+        }
+        for (std::size_t i = r.first; i < r.last; ++i) {
+            if (l.failed.load(std::memory_order_relaxed))
+                break;
+            try {
+                l.call(l.fn, i);
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(l.error_mutex);
+                if (!l.error)
+                    l.error = std::current_exception();
+                l.failed.store(true, std::memory_order_relaxed);
+            }
+        }
+        // Ostatnia operacja na l - po niej wołający może zakończyć pętlę.
+        l.done.fetch_add(r.last - r.first, std::memory_order_acq_rel);
+    }
+
+    void work(std::size_t self) {
+        current_worker() = worker_slot{this, self};
+        for (;;) {
+            range r;
+            if (pop(self, r) || steal(self, r)) {
+                run(self, r);
+                continue;
+            }
+            std::unique_lock<std::mutex> lock(sleep_mutex);
+            sleep_cv.wait(lock, [&] { return stopping || queued.load() > 0; });
+            if (stopping && queued.load() == 0)
+                return;
+        }
+    }
+};
+
+#endif //MAKSIMA_WORK_STEALING_POOL_H